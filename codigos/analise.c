@@ -0,0 +1,380 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "analise.h"
+
+int analise_ligada = 0;
+
+/* Sequência das referências na ordem da reprodução: o número de cada página, dado na primeira referência a ela. Um evento com
+ * FIM_DA_PAGINA marca a liberação da página; o número não volta a ser usado. */
+#define FIM_DA_PAGINA 0x80000000u
+static uint32_t *eventos = NULL;
+static uint32_t total_eventos = 0;
+static uint32_t capacidade_eventos = 0;
+
+/* Tabela de espalhamento (endereçamento aberto) do par processo e número da página virtual para o número da página na análise.
+ * A chave 0 marca uma posição vazia; a entrada de uma página liberada continua na tabela com o número MORTA e ganha um número novo
+ * se a página voltar a ser referenciada. */
+#define MORTA 0xFFFFFFFFu
+struct entrada_pagina {
+	uint64_t chave;
+	uint32_t numero;
+};
+static struct entrada_pagina *tabela = NULL;
+static uint32_t tamanho_tabela = 0; // potência de 2
+static uint32_t entradas_usadas = 0;
+static uint32_t paginas = 0;        // números já dados
+static uint32_t processo_atual = 0;
+
+void analise_ligar(void){
+	analise_ligada = 1;
+}
+
+void analise_troca(uint32_t pid){
+	processo_atual = pid;
+}
+
+static uint64_t chave_da_pagina(uint32_t pid, uint32_t pagina){
+	return ((uint64_t) pid << 16 | pagina) + 1;
+}
+
+static uint32_t espalhar(uint64_t chave){
+	chave *= 0x9E3779B97F4A7C15ull;
+	return (uint32_t) (chave >> 32);
+}
+
+static struct entrada_pagina *procurar_entrada(uint64_t chave){
+	uint32_t i = espalhar(chave) & (tamanho_tabela - 1);
+	while(tabela[i].chave && tabela[i].chave != chave)
+	{
+		i = (i + 1) & (tamanho_tabela - 1);
+	}
+	return &tabela[i];
+}
+
+// Dobra a tabela (ou cria a primeira) quando ela passa da metade:
+static int crescer_tabela(void){
+	struct entrada_pagina *antiga = tabela;
+	uint32_t tamanho_antigo = tamanho_tabela;
+	uint32_t i;
+	tamanho_tabela = tamanho_tabela ? tamanho_tabela * 2 : 4096;
+	tabela = calloc(tamanho_tabela, sizeof(*tabela));
+	if(!tabela)
+	{
+		tabela = antiga;
+		tamanho_tabela = tamanho_antigo;
+		return -1;
+	}
+	for(i = 0; i < tamanho_antigo; i++)
+	{
+		if(antiga[i].chave) *procurar_entrada(antiga[i].chave) = antiga[i];
+	}
+	free(antiga);
+	return 0;
+}
+
+// Sem memória para guardar as referências, a análise para e avisa; a reprodução continua:
+static void desligar(const char *motivo){
+	fprintf(stderr, "analise: %s, referencias seguintes ignoradas\n", motivo);
+	analise_ligada = 0;
+}
+
+static void registrar(uint32_t evento){
+	if(total_eventos == capacidade_eventos)
+	{
+		uint32_t capacidade = capacidade_eventos ? capacidade_eventos * 2 : 1 << 20;
+		uint32_t *novos;
+		if(capacidade_eventos >= FIM_DA_PAGINA)
+		{
+			desligar("referencias demais");
+			return;
+		}
+		novos = realloc(eventos, (size_t) capacidade * sizeof(*eventos));
+		if(!novos)
+		{
+			desligar("sem memoria");
+			return;
+		}
+		eventos = novos;
+		capacidade_eventos = capacidade;
+	}
+	eventos[total_eventos++] = evento;
+}
+
+void analise_acesso(uint32_t endereco){
+	struct entrada_pagina *e;
+	uint64_t chave = chave_da_pagina(processo_atual, endereco >> 8);
+	if((entradas_usadas + 1) * 2 > tamanho_tabela && crescer_tabela())
+	{
+		desligar("sem memoria");
+		return;
+	}
+	e = procurar_entrada(chave);
+	if(!e->chave)
+	{
+		e->chave = chave;
+		e->numero = MORTA;
+		entradas_usadas++;
+	}
+	if(e->numero == MORTA)
+	{
+		if(paginas == FIM_DA_PAGINA)
+		{
+			desligar("paginas demais");
+			return;
+		}
+		e->numero = paginas++;
+	}
+	registrar(e->numero);
+}
+
+static void liberar_pagina(uint32_t pid, uint32_t pagina){
+	struct entrada_pagina *e;
+	if(!tamanho_tabela) return;
+	e = procurar_entrada(chave_da_pagina(pid, pagina));
+	if(e->chave && e->numero != MORTA)
+	{
+		registrar(e->numero | FIM_DA_PAGINA);
+		e->numero = MORTA;
+	}
+}
+
+void analise_free(uint32_t endereco){
+	liberar_pagina(processo_atual, endereco >> 8);
+}
+
+void analise_free_range(uint32_t inicio, uint32_t fim){
+	uint32_t pagina;
+	// Os mesmos intervalos que os_free_range recusa:
+	if(inicio % 256 || fim % 256 || inicio >= fim || fim > 0x1000000) return;
+	for(pagina = inicio >> 8; pagina < fim >> 8; pagina++)
+	{
+		liberar_pagina(processo_atual, pagina);
+	}
+}
+
+void analise_exit(uint32_t pid){
+	uint32_t i;
+	for(i = 0; i < tamanho_tabela; i++)
+	{
+		if(tabela[i].chave && (tabela[i].chave - 1) >> 16 == pid && tabela[i].numero != MORTA)
+		{
+			registrar(tabela[i].numero | FIM_DA_PAGINA);
+			tabela[i].numero = MORTA;
+		}
+	}
+}
+
+/* Árvore de Fenwick sobre os instantes 1..total_eventos: o instante t vale 1 enquanto for a última referência de uma página viva.
+ * A soma de um intervalo de instantes é o número de páginas diferentes referenciadas nele. */
+static void somar_arvore(uint32_t *arvore, uint32_t t, uint32_t valor){
+	for(; t <= total_eventos; t += t & -t)
+	{
+		arvore[t] += valor;
+	}
+}
+
+static uint32_t prefixo_arvore(const uint32_t *arvore, uint32_t t){
+	uint32_t soma = 0;
+	for(; t; t -= t & -t)
+	{
+		soma += arvore[t];
+	}
+	return soma;
+}
+
+/* Preenche histograma[d] com o número de referências de distância d (1 a paginas) e retorna o número de primeiras referências.
+ * Usa ultimo (paginas posições) para o instante da última referência de cada página. */
+static uint64_t medir_distancias(uint64_t *histograma, uint32_t *ultimo){
+	uint32_t *arvore = calloc((size_t) total_eventos + 1, sizeof(*arvore));
+	uint64_t primeiras = 0;
+	uint32_t t;
+	if(!arvore) return UINT64_MAX;
+	memset(ultimo, 0, (size_t) paginas * sizeof(*ultimo));
+	for(t = 1; t <= total_eventos; t++)
+	{
+		uint32_t evento = eventos[t - 1];
+		uint32_t numero = evento & ~FIM_DA_PAGINA;
+		if(ultimo[numero])
+		{
+			somar_arvore(arvore, ultimo[numero], -1u);
+			if(!(evento & FIM_DA_PAGINA))
+			{
+				histograma[prefixo_arvore(arvore, t - 1) - prefixo_arvore(arvore, ultimo[numero]) + 1]++;
+			}
+		}
+		else if(!(evento & FIM_DA_PAGINA))
+		{
+			primeiras++;
+		}
+		ultimo[numero] = 0;
+		if(!(evento & FIM_DA_PAGINA))
+		{
+			somar_arvore(arvore, t, 1);
+			ultimo[numero] = t;
+		}
+	}
+	free(arvore);
+	return primeiras;
+}
+
+/* Heap de máximo das páginas na memória do ótimo, pelo instante da próxima referência. As entradas de uma página que já foi
+ * despejada ou referenciada de novo ficam no heap até saírem pelo topo: só vale a entrada cujo instante é o proxima[numero] atual. */
+#define SEM_PROXIMA 0xFFFFFFFEu // maior que qualquer instante: as páginas sem próxima referência saem primeiro
+#define FORA 0xFFFFFFFFu
+struct no_heap {
+	uint32_t proxima;
+	uint32_t numero;
+};
+
+static void subir_heap(struct no_heap *heap, uint32_t i){
+	struct no_heap no = heap[i];
+	while(i && heap[(i - 1) / 2].proxima < no.proxima)
+	{
+		heap[i] = heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	heap[i] = no;
+}
+
+static void descer_heap(struct no_heap *heap, uint32_t tamanho, uint32_t i){
+	struct no_heap no = heap[i];
+	for(;;)
+	{
+		uint32_t filho = 2 * i + 1;
+		if(filho >= tamanho) break;
+		if(filho + 1 < tamanho && heap[filho + 1].proxima > heap[filho].proxima) filho++;
+		if(heap[filho].proxima <= no.proxima) break;
+		heap[i] = heap[filho];
+		i = filho;
+	}
+	heap[i] = no;
+}
+
+/* Simula o algoritmo ótimo de Bélády com frames frames (pelo menos 1) e retorna o número de faltas, incluindo as primeiras referências.
+ * Usa proxima (paginas posições) para o instante da próxima referência de cada página na memória, ou FORA para as demais. */
+static uint64_t simular_otimo(uint32_t frames, uint32_t *proxima){
+	uint32_t *seguinte = malloc((size_t) total_eventos * sizeof(*seguinte));
+	uint32_t capacidade_heap = frames * 2 + 64;
+	struct no_heap *heap = malloc((size_t) capacidade_heap * sizeof(*heap));
+	uint32_t tamanho_heap = 0, ocupados = 0;
+	uint64_t faltas = 0;
+	uint32_t t, i;
+	if(!seguinte || !heap)
+	{
+		free(seguinte);
+		free(heap);
+		return UINT64_MAX;
+	}
+	// Instante da referência seguinte à página de cada evento, de trás para frente:
+	for(i = 0; i < paginas; i++)
+	{
+		proxima[i] = SEM_PROXIMA;
+	}
+	for(t = total_eventos; t-- > 0;)
+	{
+		if(eventos[t] & FIM_DA_PAGINA) continue;
+		seguinte[t] = proxima[eventos[t]];
+		proxima[eventos[t]] = t;
+	}
+	memset(proxima, 0xFF, (size_t) paginas * sizeof(*proxima));
+	for(t = 0; t < total_eventos; t++)
+	{
+		uint32_t numero = eventos[t] & ~FIM_DA_PAGINA;
+		if(eventos[t] & FIM_DA_PAGINA)
+		{
+			// Página liberada: o frame dela fica livre na hora.
+			if(proxima[numero] != FORA)
+			{
+				proxima[numero] = FORA;
+				ocupados--;
+			}
+			continue;
+		}
+		if(proxima[numero] == FORA)
+		{
+			faltas++;
+			// Com a memória cheia, despeja a página referenciada de novo mais tarde:
+			while(ocupados >= frames)
+			{
+				struct no_heap topo = heap[0];
+				heap[0] = heap[--tamanho_heap];
+				descer_heap(heap, tamanho_heap, 0);
+				if(proxima[topo.numero] == topo.proxima)
+				{
+					proxima[topo.numero] = FORA;
+					ocupados--;
+				}
+			}
+			ocupados++;
+		}
+		proxima[numero] = seguinte[t];
+		// Heap cheio de entradas vencidas: refaz só com as que valem, no máximo uma por frame.
+		if(tamanho_heap == capacidade_heap)
+		{
+			uint32_t validas = 0;
+			for(i = 0; i < tamanho_heap; i++)
+			{
+				if(proxima[heap[i].numero] == heap[i].proxima) heap[validas++] = heap[i];
+			}
+			tamanho_heap = validas;
+			for(i = tamanho_heap / 2; i-- > 0;)
+			{
+				descer_heap(heap, tamanho_heap, i);
+			}
+		}
+		heap[tamanho_heap] = (struct no_heap) { seguinte[t], numero };
+		subir_heap(heap, tamanho_heap++);
+	}
+	free(seguinte);
+	free(heap);
+	return faltas;
+}
+
+int analise_relatorio(FILE *curva, uint32_t frames, uint64_t paginas_carregadas){
+	uint64_t *histograma = calloc((size_t) paginas + 2, sizeof(*histograma));
+	uint32_t *por_pagina = malloc(((size_t) paginas + 1) * sizeof(*por_pagina));
+	uint64_t referencias = 0, primeiras, faltas, faltas_lru = 0, faltas_otimo;
+	uint32_t maior = 0, f;
+	int erro = 0;
+	if(!histograma || !por_pagina || (primeiras = medir_distancias(histograma, por_pagina)) == UINT64_MAX)
+	{
+		fprintf(stderr, "analise: sem memoria\n");
+		free(histograma);
+		free(por_pagina);
+		return 1;
+	}
+	for(f = 1; f <= paginas; f++)
+	{
+		referencias += histograma[f];
+		if(histograma[f]) maior = f;
+	}
+	referencias += primeiras;
+	// faltas(f) = primeiras referências + referências com distância maior que f:
+	faltas = referencias;
+	fprintf(curva, "frames,faltas,taxa_faltas\n");
+	for(f = 1; f <= maior; f++)
+	{
+		faltas -= histograma[f];
+		if(f == frames) faltas_lru = faltas;
+		fprintf(curva, "%" PRIu32 ",%" PRIu64 ",%.6f\n", f, faltas, referencias ? (double) faltas / referencias : 0.0);
+	}
+	if(frames > maior) faltas_lru = primeiras;
+	faltas_otimo = simular_otimo(frames, por_pagina);
+	if(faltas_otimo == UINT64_MAX)
+	{
+		fprintf(stderr, "analise: sem memoria\n");
+		erro = 1;
+	}
+	else
+	{
+		fprintf(stderr, "analise: %" PRIu64 " referencias a %" PRIu32 " paginas, curva de faltas ate %" PRIu32 " frames\n",
+			referencias, paginas, maior);
+		fprintf(stderr, "analise: com %" PRIu32 " frames, faltas sem as primeiras referencias: lru %" PRIu64 " otimo %" PRIu64
+			" politica do simulador %" PRIu64 " paginas carregadas\n",
+			frames, faltas_lru - primeiras, faltas_otimo - primeiras, paginas_carregadas);
+	}
+	free(histograma);
+	free(por_pagina);
+	return erro;
+}
@@ -0,0 +1,34 @@
+#ifndef TPSO2_analise_h
+#define TPSO2_analise_h
+
+#include <stdio.h>
+#include <inttypes.h>
+
+/* Análise das distâncias de reuso (opção -A de main), para dimensionar a memória sem reproduzir o arquivo de acessos uma vez por tamanho.
+ * Durante a reprodução, executar_comando passa para cá cada leitura e escrita com o processo que a fez; no fim, cada referência a uma
+ * página (processo, número da página) recebe a sua distância de pilha LRU: quantas páginas diferentes foram usadas desde a referência
+ * anterior à mesma página, contando ela. Uma memória LRU com f frames acerta exatamente as referências com distância até f, então o
+ * histograma das distâncias dá a curva de faltas de todos os tamanhos de uma vez. As distâncias saem de uma árvore de Fenwick indexada
+ * pelo instante da última referência de cada página, em O(log n) por referência. Para um número de frames escolhido, a análise simula
+ * também o algoritmo ótimo de Bélády (despeja a página usada de novo mais tarde), o piso para qualquer política de substituição.
+ *
+ * Páginas liberadas (free, free_range, exit) saem da pilha; se forem alocadas de novo, contam como páginas novas. As páginas que um
+ * processo herda num fork também contam como páginas novas do filho, mesmo quando o simulador as compartilha com o pai. */
+
+extern int analise_ligada;
+
+// Liga a coleta das referências; deve ser chamada antes da reprodução, que não pode usar várias threads:
+void analise_ligar(void);
+// Chamadas por executar_comando:
+void analise_troca(uint32_t pid);
+void analise_acesso(uint32_t endereco);
+void analise_free(uint32_t endereco);
+void analise_free_range(uint32_t inicio, uint32_t fim);
+void analise_exit(uint32_t pid);
+/* Grava em curva a curva de faltas em csv (frames, faltas e taxa de faltas, de 1 frame até o tamanho em que só faltam as primeiras
+ * referências) e escreve em stderr o resumo com as faltas de LRU e do ótimo com frames frames, ao lado das páginas_carregadas
+ * pela política do simulador. As faltas do resumo não contam as primeiras referências, que o simulador também atende sem ir ao disco.
+ * Retorna 0 em caso de sucesso: */
+int analise_relatorio(FILE *curva, uint32_t frames, uint64_t paginas_carregadas);
+
+#endif
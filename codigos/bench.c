@@ -0,0 +1,172 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "bench.h"
+#include "tp2.h"
+#include "vmm.h"
+#include "log.h"
+#include "estatisticas.h"
+
+static double agora(void){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+void bench_alocador(uint32_t rodadas){
+	uint32_t frames[NUMFRAMES];
+	uint32_t semente = 0x9E3779B9;
+	uint32_t r, i, n = 0;
+	uint64_t alocacoes = 0, liberacoes = 0;
+	double t_aloc = 0.0, t_lib = 0.0, t;
+
+	for(r = 0; r < rodadas; r++)
+	{
+		// Enche a memória de dados:
+		t = agora();
+		for(n = 0; (frames[n] = procurar_frame_livre_dados()); n++);
+		t_aloc += agora() - t;
+		alocacoes += n;
+		// Embaralha a ordem de liberação para que a próxima rodada encontre o mapa fragmentado:
+		for(i = n; i > 1; i--)
+		{
+			semente ^= semente << 13;
+			semente ^= semente >> 17;
+			semente ^= semente << 5;
+			uint32_t k = semente % i;
+			uint32_t aux = frames[i - 1];
+			frames[i - 1] = frames[k];
+			frames[k] = aux;
+		}
+		// Esvazia a memória de dados:
+		t = agora();
+		for(i = 0; i < n; i++)
+		{
+			liberar_frame_dados(frames[i]);
+		}
+		t_lib += agora() - t;
+		liberacoes += n;
+	}
+	printf("bench alocador: %u rodadas, %u frames por rodada\n", rodadas, n);
+	printf("  alocacao  %" PRIu64 " frames em %.6f s (%.1f ns/frame)\n", alocacoes, t_aloc, alocacoes ? 1e9 * t_aloc / alocacoes : 0.0);
+	printf("  liberacao %" PRIu64 " frames em %.6f s (%.1f ns/frame)\n", liberacoes, t_lib, liberacoes ? 1e9 * t_lib / liberacoes : 0.0);
+	printf("  frames livres ao final: %u\n", frames_livres_dados());
+}
+
+// Frames que cada thread mantém alocados em cada rodada do bench com várias threads:
+#define FRAMES_POR_RODADA 16
+
+struct bench_thread {
+	pthread_t thread;
+	uint32_t rodadas;
+	int cache;
+	uint64_t alocacoes;
+};
+
+static void *alocar_e_liberar(void *arg){
+	struct bench_thread *b = arg;
+	uint32_t frames[FRAMES_POR_RODADA];
+	uint32_t r, i, n;
+	if(b->cache) os_iniciar_thread();
+	for(r = 0; r < b->rodadas; r++)
+	{
+		for(n = 0; n < FRAMES_POR_RODADA && (frames[n] = procurar_frame_livre_dados()); n++);
+		for(i = 0; i < n; i++)
+		{
+			liberar_frame_dados(frames[i]);
+		}
+		b->alocacoes += n;
+	}
+	if(b->cache) os_encerrar_thread();
+	return NULL;
+}
+
+// Mede a vazão do alocador com "threads" threads alocando e liberando ao mesmo tempo; retorna alocações por segundo:
+static double vazao_alocador(uint32_t threads, uint32_t rodadas, int cache){
+	struct bench_thread b[64];
+	uint64_t alocacoes = 0;
+	uint32_t t;
+	double inicio = agora();
+	for(t = 0; t < threads; t++)
+	{
+		b[t].rodadas = rodadas;
+		b[t].cache = cache;
+		b[t].alocacoes = 0;
+		if(pthread_create(&b[t].thread, NULL, alocar_e_liberar, &b[t]))
+		{
+			perror("pthread_create");
+			exit(EXIT_FAILURE);
+		}
+	}
+	for(t = 0; t < threads; t++)
+	{
+		pthread_join(b[t].thread, NULL);
+		alocacoes += b[t].alocacoes;
+	}
+	double segundos = agora() - inicio;
+	return segundos > 0 ? alocacoes / segundos : 0.0;
+}
+
+void bench_alocador_threads(uint32_t rodadas){
+	static const uint32_t threads[] = { 1, 4, 16, 64 };
+	uint32_t i;
+	printf("bench alocador com threads: %u rodadas de %u frames por thread, %ld processadores\n",
+		rodadas, FRAMES_POR_RODADA, sysconf(_SC_NPROCESSORS_ONLN));
+	printf("  threads  sem cache (alocacoes/s)  com cache (alocacoes/s)\n");
+	for(i = 0; i < sizeof(threads) / sizeof(threads[0]); i++)
+	{
+		double sem = vazao_alocador(threads[i], rodadas, 0);
+		double com = vazao_alocador(threads[i], rodadas, 1);
+		printf("  %7u  %23.0f  %23.0f\n", threads[i], sem, com);
+	}
+	printf("  frames livres ao final: %u\n", frames_livres_dados());
+}
+
+// Páginas grandes que o bench de páginas grandes mapeia, e palavras lidas em cada página de 4 KB equivalente:
+#define PAGINAS_GRANDES_BENCH 4
+#define LEITURAS_POR_PAGINA 16
+
+// Percorre sequencialmente uma região de PAGINAS_GRANDES_BENCH * 256 páginas, "rodadas" vezes, com a região mapeada em páginas comuns
+// (grandes = 0) ou grandes, e imprime a vazão e o custo dos percursos na tabela de páginas:
+static void percorrer_regiao(uint32_t rodadas, int grandes){
+	uint32_t paginas = PAGINAS_GRANDES_BENCH * HUGE_FRAMES;
+	uint32_t r, p, w;
+	int nivel = log_nivel;
+	log_nivel = NIVEL_NADA;
+	os_paginas_grandes(grandes);
+	os_swap(1);
+	os_alloc_range(0x0, paginas);
+	estatisticas_zerar();
+	double inicio = agora();
+	for(r = 0; r < rodadas; r++)
+	{
+		for(p = 0; p < paginas; p++)
+		{
+			for(w = 0; w < 0x100; w += 0x100 / LEITURAS_POR_PAGINA)
+			{
+				dccvmm_read(p << 8 | w);
+			}
+		}
+	}
+	double segundos = agora() - inicio;
+	printf("  %-8s %14.0f %12" PRIu64 " %14" PRIu64 " %10.3f\n", grandes ? "grandes" : "comuns",
+		segundos > 0 ? estat.leituras / segundos : 0.0, estat.percursos, estat.leituras_pte,
+		estat.percursos ? (double) estat.leituras_pte / estat.percursos : 0.0);
+	os_exit(1);
+	os_paginas_grandes(0);
+	log_nivel = nivel;
+}
+
+void bench_paginas_grandes(uint32_t rodadas){
+	printf("bench paginas grandes: %u rodadas sobre %u paginas, %u leituras por pagina\n",
+		rodadas, PAGINAS_GRANDES_BENCH * HUGE_FRAMES, LEITURAS_POR_PAGINA);
+	printf("  paginas   leituras/s     percursos   leituras_pte   pte/percurso\n");
+	percorrer_regiao(rodadas, 0);
+	percorrer_regiao(rodadas, 1);
+	printf("  frames livres ao final: %u\n", frames_livres_dados());
+}
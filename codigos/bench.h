@@ -0,0 +1,14 @@
+#ifndef TPSO2_bench_h
+#define TPSO2_bench_h
+
+#include <inttypes.h>
+
+// Micro-benchmarks do simulador (opção -B de main):
+// Enche e esvazia toda a memória de dados com o alocador de frames, "rodadas" vezes.
+void bench_alocador(uint32_t rodadas);
+// Vazão do alocador de frames com 1, 4, 16 e 64 threads alocando e liberando ao mesmo tempo, sem e com o cache de frames por thread.
+void bench_alocador_threads(uint32_t rodadas);
+// Leitura sequencial de uma região mapeada em páginas comuns e depois em páginas grandes (PTE_HUGE), "rodadas" vezes.
+void bench_paginas_grandes(uint32_t rodadas);
+
+#endif
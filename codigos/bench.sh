@@ -0,0 +1,125 @@
+#!/bin/sh
+# Conjunto de benchmarks do simulador (make bench): gera os arquivos de acessos
+# com tp2 -G, reproduz cada um no formato binario e compara a vazao e o pico de
+# memoria e o tempo de parede com uma referencia medida nesta mesma maquina.
+#
+# uso: ./bench.sh        compara com a base local; os casos que ainda nao estao
+#                        nela sao medidos e acrescentados, sem comparacao
+#      ./bench.sh base   grava os resultados desta maquina como a nova base local
+#
+# A referencia e uma das duas:
+#  - TP2_BASE=caminho/do/tp2: outro binario compilado nesta maquina (por exemplo
+#    o do commit anterior). Em cada rodada os dois binarios executam um depois do
+#    outro, entao a variacao da maquina afeta os dois; nenhuma base e gravada.
+#  - a base local em $BASE (padrao $BENCH_DIR/base.txt), gravada por esta
+#    maquina. Numeros absolutos de outra maquina nao servem de referencia, por
+#    isso a base nao fica no repositorio.
+#
+# Variaveis: BENCH_DIR (onde ficam os arquivos gerados e a base), TOLERANCIA
+# (piora aceita, em %, padrao 20) e RODADAS (execucoes de cada caso; vale a
+# mais rapida, padrao 5).
+
+BENCH_DIR=${BENCH_DIR:-${TMPDIR:-/tmp}/tp2_bench}
+TOLERANCIA=${TOLERANCIA:-20}
+RODADAS=${RODADAS:-5}
+BASE=${BASE:-$BENCH_DIR/base.txt}
+TP2=./tp2
+modo=$1
+
+# padrao,paginas,acessos,processos,semente
+CASOS="
+sequencial,8192,1000000,1,1
+estride,8192,1000000,1,2
+aleatorio,6144,1000000,1,3
+zipf,16384,1000000,1,4
+aleatorio,512,1000000,16,5
+rotatividade,4096,1000000,4,6
+"
+
+# Os arquivos gerados levam no nome uma soma do gerador e do formato binario:
+# quando um dos dois muda, os casos sao gerados de novo em vez de reaproveitados.
+versao=$(cat gerador.c gerador.h trace.h | cksum | awk '{ print $1 }')
+
+# Executa o binario $1 no caso $2 uma vez e escreve "vazao pico_KB tempo_s":
+medir() {
+	linha=$($1 -b -l resumo "$2" 2>&1 >/dev/null | grep '^execucao:')
+	[ -n "$linha" ] || return 1
+	echo "$linha" | awk '{ print $8, $12, $3 }'
+}
+
+# Maior e menor de dois valores; o menor trata 0 como "ainda sem valor":
+maior() { awk -v a="$1" -v b="$2" 'BEGIN { print (b > a) ? b : a }'; }
+menor() { awk -v a="$1" -v b="$2" 'BEGIN { print (a == 0 || b < a) ? b : a }'; }
+
+mkdir -p "$BENCH_DIR" || exit 1
+resultados="$BENCH_DIR/resultados.txt"
+novos="$BENCH_DIR/novos.txt"
+: > "$resultados"
+: > "$novos"
+if [ -n "$TP2_BASE" ]; then
+	printf '%-36s %12s %12s %10s %10s %8s %10s\n' caso acessos/s referencia pico_KB referencia tempo_s referencia
+else
+	printf '%-36s %12s %12s %10s %8s %8s\n' caso acessos/s base pico_KB tempo_s base
+fi
+erro=0
+for caso in $CASOS; do
+	nome=$(echo "$caso" | tr ',' '_')
+	bin="$BENCH_DIR/${nome}_$versao.bin"
+	if [ ! -f "$bin" ]; then
+		$TP2 -G "$caso" > "$BENCH_DIR/$nome.txt" && $TP2 -c "$bin" "$BENCH_DIR/$nome.txt" >/dev/null 2>&1 || exit 1
+		rm -f "$BENCH_DIR/$nome.txt"
+	fi
+	melhor=0 pico=0 tempo=0 ref_melhor=0 ref_pico=0 ref_tempo=0
+	i=0
+	while [ $i -lt "$RODADAS" ]; do
+		r=$(medir $TP2 "$bin") || { echo "$nome: tp2 falhou"; exit 1; }
+		set -- $r
+		melhor=$(maior "$melhor" "$1")
+		pico=$(maior "$pico" "$2")
+		tempo=$(menor "$tempo" "$3")
+		if [ -n "$TP2_BASE" ]; then
+			r=$(medir "$TP2_BASE" "$bin") || { echo "$nome: $TP2_BASE falhou"; exit 1; }
+			set -- $r
+			ref_melhor=$(maior "$ref_melhor" "$1")
+			ref_pico=$(maior "$ref_pico" "$2")
+			ref_tempo=$(menor "$ref_tempo" "$3")
+		fi
+		i=$((i + 1))
+	done
+	echo "${nome}_$versao $melhor $pico $tempo" >> "$resultados"
+
+	if [ -n "$TP2_BASE" ]; then
+		ref="$ref_melhor $ref_pico $ref_tempo"
+	else
+		ref=$( [ "$modo" != base ] && [ -f "$BASE" ] && awk -v n="${nome}_$versao" '$1 == n { print $2, $3, $4 }' "$BASE")
+	fi
+	if [ -n "$ref" ]; then
+		set -- $ref
+		situacao=$(awk -v v="$melhor" -v k="$pico" -v s="$tempo" -v bv="$1" -v bk="$2" -v bs="$3" -v t="$TOLERANCIA" 'BEGIN {
+			r = sprintf("%+.1f%%", 100 * (v - bv) / bv)
+			if(v < bv * (100 - t) / 100) r = r " LENTO"
+			if(k > bk * (100 + t) / 100) r = r " MEMORIA"
+			if(s > bs * (100 + t) / 100) r = r " TEMPO"
+			print r
+		}')
+		case "$situacao" in *LENTO*|*MEMORIA*|*TEMPO*) erro=1 ;; esac
+		if [ -n "$TP2_BASE" ]; then
+			printf '%-36s %12s %12s %10s %10s %8s %10s %s\n' "$nome" "$melhor" "$1" "$pico" "$2" "$tempo" "$3" "$situacao"
+		else
+			printf '%-36s %12s %12s %10s %8s %8s %s\n' "$nome" "$melhor" "$1" "$pico" "$tempo" "$3" "$situacao"
+		fi
+	else
+		echo "${nome}_$versao $melhor $pico $tempo" >> "$novos"
+		printf '%-36s %12s %12s %10s %8s %8s\n' "$nome" "$melhor" - "$pico" "$tempo" -
+	fi
+done
+
+if [ "$modo" = base ]; then
+	cp "$resultados" "$BASE" && echo "base gravada em $BASE"
+	exit 0
+fi
+if [ -z "$TP2_BASE" ] && [ -s "$novos" ]; then
+	cat "$novos" >> "$BASE" && echo "casos sem base acrescentados a $BASE"
+fi
+[ $erro -eq 0 ] || echo "regressao: algum caso ficou mais de $TOLERANCIA% pior que a referencia"
+exit $erro
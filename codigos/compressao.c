@@ -0,0 +1,79 @@
+#include <string.h>
+
+#include "compressao.h"
+
+#define PALAVRAS_FRAME (sizeof(struct frame) / sizeof(uint32_t))
+#define MAXIMO_LITERAIS 0x80
+#define MAXIMO_REPETICOES 0x40
+
+// Acrescenta um trecho de literais ao código; retorna 0 se ele não couber:
+static int escrever_literais(uint8_t *destino, uint32_t *n, const uint32_t *palavras, uint32_t quantas, uint32_t limite){
+	if(*n + 1 + 4 * quantas > limite) return 0;
+	destino[(*n)++] = (uint8_t) (quantas - 1);
+	memcpy(&destino[*n], palavras, 4 * quantas);
+	*n += 4 * quantas;
+	return 1;
+}
+
+uint32_t comprimir_frame(const struct frame *frame, uint8_t *destino, uint32_t limite){
+	const uint32_t *w = frame->words;
+	uint32_t i = 0, n = 0, literais = 0;
+	while(i < PALAVRAS_FRAME)
+	{
+		uint32_t r = 1;
+		while(i + r < PALAVRAS_FRAME && r < MAXIMO_REPETICOES && w[i + r] == w[i])
+		{
+			r++;
+		}
+		// Uma palavra zero sozinha já vale um trecho (1 byte em vez de 4); outras palavras só a partir de duas repetições:
+		if(r < 2 && w[i] != 0)
+		{
+			i++;
+			if(++literais == MAXIMO_LITERAIS)
+			{
+				if(!escrever_literais(destino, &n, &w[i - literais], literais, limite)) return 0;
+				literais = 0;
+			}
+			continue;
+		}
+		if(literais && !escrever_literais(destino, &n, &w[i - literais], literais, limite)) return 0;
+		literais = 0;
+		if(n + (w[i] ? 5 : 1) > limite) return 0;
+		destino[n++] = (uint8_t) ((w[i] ? 0xC0 : 0x80) | (r - 1));
+		if(w[i])
+		{
+			memcpy(&destino[n], &w[i], 4);
+			n += 4;
+		}
+		i += r;
+	}
+	if(literais && !escrever_literais(destino, &n, &w[i - literais], literais, limite)) return 0;
+	return n;
+}
+
+void descomprimir_frame(const uint8_t *origem, uint32_t tamanho, struct frame *frame){
+	uint32_t *w = frame->words;
+	uint32_t i = 0, n = 0;
+	while(n < tamanho && i < PALAVRAS_FRAME)
+	{
+		uint8_t controle = origem[n++];
+		uint32_t quantas = (controle & 0x80) ? (uint32_t) (controle & 0x3F) + 1 : (uint32_t) controle + 1;
+		if(!(controle & 0x80))
+		{
+			memcpy(&w[i], &origem[n], 4 * quantas);
+			n += 4 * quantas;
+			i += quantas;
+			continue;
+		}
+		uint32_t palavra = 0;
+		if(controle & 0x40)
+		{
+			memcpy(&palavra, &origem[n], 4);
+			n += 4;
+		}
+		while(quantas--)
+		{
+			w[i++] = palavra;
+		}
+	}
+}
@@ -0,0 +1,22 @@
+#ifndef TPSO2_compressao_h
+#define TPSO2_compressao_h
+
+#include <inttypes.h>
+
+#include "vmm.h"
+
+/* Compressão de frames para o cache comprimido do estágio de E/S (disco.c). O formato trabalha com as 256 palavras do frame,
+ * não com bytes: frames de páginas pouco usadas são quase todos de palavras zero ou repetidas. O código é uma sequência de trechos,
+ * cada um começando com um byte de controle:
+ *   0x00 a 0x7F: (byte + 1) palavras literais, que vêm em seguida;
+ *   0x80 a 0xBF: (byte & 0x3F) + 1 palavras zero;
+ *   0xC0 a 0xFF: (byte & 0x3F) + 1 repetições da palavra que vem em seguida.
+ * As palavras ficam na ordem de bytes da máquina: o código nunca sai da memória. */
+#define COMPRESSAO_MAXIMO (sizeof(struct frame) + 2) // tamanho do pior caso, só de literais
+
+// Comprime o frame em destino, que tem espaço para limite bytes. Retorna o tamanho do código, ou 0 se ele passar de limite:
+uint32_t comprimir_frame(const struct frame *frame, uint8_t *destino, uint32_t limite);
+// Reconstrói em frame o conteúdo comprimido por comprimir_frame:
+void descomprimir_frame(const uint8_t *origem, uint32_t tamanho, struct frame *frame);
+
+#endif
@@ -0,0 +1,408 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "disco.h"
+#include "vmm.h"
+#include "compressao.h"
+#include "estatisticas.h"
+
+// Gravações que cabem na fila; quem grava com a fila cheia espera a thread de fundo:
+#define FILA_DISCO 64
+
+struct pedido {
+	uint32_t setor;
+	struct frame dados;
+};
+
+static uint32_t latencia_acesso = 0;
+static uint32_t latencia_transferencia = 0;
+static int assincrono = 0;
+/* A fila recebe as gravações na ordem em que chegam. A thread de fundo passa a fila inteira para o lote e grava o lote sem a trava;
+ * os setores do lote continuam visíveis para as leituras até serem gravados. Um setor pode aparecer mais de uma vez: vale o mais novo,
+ * que é o mais perto do fim (da fila, e depois do lote). */
+static struct pedido fila[FILA_DISCO];
+static uint32_t na_fila = 0;
+static struct pedido lote[FILA_DISCO];
+static uint32_t no_lote = 0;
+static int thread_ativa = 0;
+static pthread_t thread_disco;
+static pthread_mutex_t trava_fila = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fila_com_pedidos = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t fila_andou = PTHREAD_COND_INITIALIZER; // a fila ganhou espaço ou um lote terminou
+// Contadores da thread de fundo ainda não somados por disco_esvaziar:
+static struct estatisticas estat_fundo;
+
+/* Cache comprimido: cada página guardada é um bloco alocado com o código de comprimir_frame, achado pelo setor numa tabela hash
+ * e encadeado numa lista em ordem de uso, da mais fria para a mais quente. */
+struct comprimida {
+	uint32_t setor;
+	uint32_t tamanho;
+	struct comprimida *proxima_no_balde;
+	struct comprimida *anterior, *seguinte;
+	uint8_t codigo[];
+};
+
+#define BALDES_COMPRIMIDAS 4096
+static struct comprimida *baldes[BALDES_COMPRIMIDAS];
+static struct comprimida *mais_fria, *mais_quente;
+static size_t orcamento = 0;
+static size_t ocupado = 0;   // bytes dos blocos, com os cabeçalhos
+static uint32_t limite_compressao = sizeof(struct frame) / 2;
+// Pega antes da trava da fila:
+static pthread_mutex_t trava_comprimidas = PTHREAD_MUTEX_INITIALIZER;
+
+void disco_latencia(uint32_t acesso, uint32_t transferencia){
+	latencia_acesso = acesso;
+	latencia_transferencia = transferencia;
+}
+
+void disco_assincrono(int ligar){
+	assincrono = ligar;
+}
+
+void disco_compressao(uint32_t bytes, uint32_t limite){
+	orcamento = bytes;
+	if(limite) limite_compressao = limite < COMPRESSAO_MAXIMO ? limite : COMPRESSAO_MAXIMO;
+}
+
+static uint64_t microssegundos(void){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+// Simula um pedido de "setores" setores seguidos:
+static void pedido_disco(uint32_t setores){
+	uint64_t espera = latencia_acesso + (uint64_t) latencia_transferencia * setores;
+	ESTAT_INC(pedidos_disco);
+	if(espera)
+	{
+		struct timespec t = { (time_t) (espera / 1000000), (long) (espera % 1000000) * 1000 };
+		nanosleep(&t, NULL);
+	}
+}
+
+// Ordena os índices do lote por setor, mantendo a ordem de chegada entre pedidos do mesmo setor:
+static void ordenar_lote(uint32_t *ordem, uint32_t total){
+	uint32_t i, j;
+	for(i = 0; i < total; i++)
+	{
+		uint32_t k = ordem[i];
+		for(j = i; j > 0 && lote[ordem[j - 1]].setor > lote[k].setor; j--)
+		{
+			ordem[j] = ordem[j - 1];
+		}
+		ordem[j] = k;
+	}
+}
+
+static void *gravar_em_fundo(void *arg){
+	uint32_t ordem[FILA_DISCO];
+	uint32_t i, j, k, total, unicos;
+	(void) arg;
+	pthread_mutex_lock(&trava_fila);
+	for(;;)
+	{
+		while(na_fila == 0)
+		{
+			pthread_cond_wait(&fila_com_pedidos, &trava_fila);
+		}
+		memcpy(lote, fila, na_fila * sizeof(fila[0]));
+		no_lote = total = na_fila;
+		na_fila = 0;
+		pthread_cond_broadcast(&fila_andou);
+		pthread_mutex_unlock(&trava_fila);
+
+		for(i = 0; i < total; i++)
+		{
+			ordem[i] = i;
+		}
+		ordenar_lote(ordem, total);
+		// De um setor repetido só a gravação mais nova, a última depois da ordenação, vai ao disco:
+		for(i = 0, unicos = 0; i < total; i++)
+		{
+			if(i + 1 == total || lote[ordem[i + 1]].setor != lote[ordem[i]].setor)
+			{
+				ordem[unicos++] = ordem[i];
+			}
+		}
+		// Cada trecho de setores seguidos vira um pedido:
+		for(i = 0; i < unicos; i = j)
+		{
+			for(j = i + 1; j < unicos && lote[ordem[j]].setor == lote[ordem[j - 1]].setor + 1; j++);
+			pedido_disco(j - i);
+			for(k = i; k < j; k++)
+			{
+				dccvmm_dump_data(&lote[ordem[k]].dados, lote[ordem[k]].setor);
+			}
+		}
+
+		pthread_mutex_lock(&trava_fila);
+		no_lote = 0;
+		estatisticas_acumular(&estat_fundo, &estat);
+		estatisticas_zerar();
+		pthread_cond_broadcast(&fila_andou);
+	}
+	return NULL;
+}
+
+static void gravar_no_disco(const struct frame *dados, uint32_t setor){
+	if(!assincrono)
+	{
+		uint64_t inicio = microssegundos();
+		pedido_disco(1);
+		dccvmm_dump_data(dados, setor);
+		ESTAT_ADD(espera_disco_us, microssegundos() - inicio);
+		return;
+	}
+	pthread_mutex_lock(&trava_fila);
+	if(na_fila == FILA_DISCO)
+	{
+		uint64_t inicio = microssegundos();
+		while(na_fila == FILA_DISCO)
+		{
+			pthread_cond_wait(&fila_andou, &trava_fila);
+		}
+		ESTAT_ADD(espera_disco_us, microssegundos() - inicio);
+	}
+	fila[na_fila].setor = setor;
+	memcpy(&fila[na_fila].dados, dados, sizeof(fila[0].dados));
+	na_fila++;
+	if(!thread_ativa && pthread_create(&thread_disco, NULL, gravar_em_fundo, NULL) == 0)
+	{
+		pthread_detach(thread_disco);
+		thread_ativa = 1;
+	}
+	pthread_cond_signal(&fila_com_pedidos);
+	pthread_mutex_unlock(&trava_fila);
+}
+
+static struct comprimida **balde(uint32_t setor){
+	return &baldes[(setor * 2654435761u) >> 20 & (BALDES_COMPRIMIDAS - 1)];
+}
+
+// Procura a página do setor no cache comprimido; chamada com a trava do cache:
+static struct comprimida *procurar_comprimida(uint32_t setor){
+	struct comprimida *c;
+	for(c = *balde(setor); c && c->setor != setor; c = c->proxima_no_balde);
+	return c;
+}
+
+static void tirar_da_lista(struct comprimida *c){
+	if(c->anterior) c->anterior->seguinte = c->seguinte;
+	else mais_fria = c->seguinte;
+	if(c->seguinte) c->seguinte->anterior = c->anterior;
+	else mais_quente = c->anterior;
+}
+
+static void por_no_fim(struct comprimida *c){
+	c->anterior = mais_quente;
+	c->seguinte = NULL;
+	if(mais_quente) mais_quente->seguinte = c;
+	else mais_fria = c;
+	mais_quente = c;
+}
+
+static void apagar_comprimida(struct comprimida *c){
+	struct comprimida **p;
+	for(p = balde(c->setor); *p != c; p = &(*p)->proxima_no_balde);
+	*p = c->proxima_no_balde;
+	tirar_da_lista(c);
+	ocupado -= sizeof(*c) + c->tamanho;
+	free(c);
+}
+
+// Manda para o disco a página mais fria do cache comprimido:
+static void expulsar_comprimida(void){
+	struct frame dados;
+	struct comprimida *c = mais_fria;
+	descomprimir_frame(c->codigo, c->tamanho, &dados);
+	gravar_no_disco(&dados, c->setor);
+	apagar_comprimida(c);
+	ESTAT_INC(expulsas_comprimidas);
+}
+
+/* Guarda o frame comprimido no lugar do setor. Retorna 0 se ele comprime mal ou não cabe no orçamento, e nesse caso a página vai
+ * para o disco; a cópia antiga do setor no cache, se houver, sai de qualquer jeito. */
+static int guardar_comprimida(const struct frame *dados, uint32_t setor){
+	uint8_t codigo[COMPRESSAO_MAXIMO];
+	uint32_t tamanho = comprimir_frame(dados, codigo, limite_compressao);
+	pthread_mutex_lock(&trava_comprimidas);
+	struct comprimida *c = procurar_comprimida(setor);
+	if(c)
+	{
+		apagar_comprimida(c);
+	}
+	if(tamanho == 0 || sizeof(*c) + tamanho > orcamento)
+	{
+		pthread_mutex_unlock(&trava_comprimidas);
+		ESTAT_INC(recusadas_compressao);
+		return 0;
+	}
+	while(ocupado + sizeof(*c) + tamanho > orcamento)
+	{
+		expulsar_comprimida();
+	}
+	c = malloc(sizeof(*c) + tamanho);
+	if(!c)
+	{
+		pthread_mutex_unlock(&trava_comprimidas);
+		return 0;
+	}
+	c->setor = setor;
+	c->tamanho = tamanho;
+	memcpy(c->codigo, codigo, tamanho);
+	c->proxima_no_balde = *balde(setor);
+	*balde(setor) = c;
+	por_no_fim(c);
+	ocupado += sizeof(*c) + tamanho;
+	pthread_mutex_unlock(&trava_comprimidas);
+	ESTAT_INC(paginas_comprimidas);
+	ESTAT_ADD(bytes_comprimidos, tamanho);
+	return 1;
+}
+
+void disco_gravar(uint32_t frame, uint32_t setor){
+	if(orcamento && guardar_comprimida(&__frames[frame], setor))
+	{
+		return;
+	}
+	gravar_no_disco(&__frames[frame], setor);
+}
+
+void disco_gravar_mapa(uint32_t frame, uint32_t setor){
+	gravar_no_disco(&__frames[frame], setor);
+}
+
+void disco_descartar(uint32_t setor){
+	if(!orcamento)
+	{
+		return;
+	}
+	pthread_mutex_lock(&trava_comprimidas);
+	struct comprimida *c = procurar_comprimida(setor);
+	if(c)
+	{
+		apagar_comprimida(c);
+	}
+	pthread_mutex_unlock(&trava_comprimidas);
+}
+
+void disco_descarregar(void){
+	pthread_mutex_lock(&trava_comprimidas);
+	while(mais_fria)
+	{
+		expulsar_comprimida();
+	}
+	pthread_mutex_unlock(&trava_comprimidas);
+	disco_esvaziar();
+}
+
+// Procura a gravação mais nova do setor na fila e no lote em gravação; chamada com a trava da fila:
+static const struct frame *gravacao_pendente(uint32_t setor){
+	uint32_t i;
+	for(i = na_fila; i > 0; i--)
+	{
+		if(fila[i - 1].setor == setor) return &fila[i - 1].dados;
+	}
+	for(i = no_lote; i > 0; i--)
+	{
+		if(lote[i - 1].setor == setor) return &lote[i - 1].dados;
+	}
+	return NULL;
+}
+
+void disco_ler(const uint32_t *setores, const uint32_t *frames, uint32_t n){
+	uint32_t i, j, faltam = 0, fora_do_cache = 0;
+	if(n == 0)
+	{
+		return;
+	}
+	uint32_t pendentes[n];
+	// O cache comprimido tem a cópia mais nova do setor: uma gravação posterior teria tirado a página dele. A página continua no cache,
+	// que é a única cópia dela enquanto não for expulsa.
+	if(orcamento)
+	{
+		pthread_mutex_lock(&trava_comprimidas);
+		for(i = 0; i < n; i++)
+		{
+			struct comprimida *c = procurar_comprimida(setores[i]);
+			if(c)
+			{
+				descomprimir_frame(c->codigo, c->tamanho, &__frames[frames[i]]);
+				tirar_da_lista(c);
+				por_no_fim(c);
+				ESTAT_INC(leituras_comprimidas);
+			}
+			else
+			{
+				pendentes[fora_do_cache++] = i;
+			}
+		}
+		pthread_mutex_unlock(&trava_comprimidas);
+	}
+	else
+	{
+		for(i = 0; i < n; i++)
+		{
+			pendentes[i] = i;
+		}
+		fora_do_cache = n;
+	}
+	// pendentes[0..fora_do_cache-1] são os setores que não estavam no cache comprimido:
+	pthread_mutex_lock(&trava_fila);
+	for(j = 0; j < fora_do_cache; j++)
+	{
+		i = pendentes[j];
+		const struct frame *dados = (na_fila || no_lote) ? gravacao_pendente(setores[i]) : NULL;
+		if(dados)
+		{
+			memcpy(&__frames[frames[i]], dados, sizeof(*dados));
+			ESTAT_INC(leituras_da_fila);
+		}
+		else
+		{
+			pendentes[faltam++] = i;
+		}
+	}
+	pthread_mutex_unlock(&trava_fila);
+	// O resto vai ao disco em ordem de setor, um pedido por trecho de setores seguidos:
+	for(i = 1; i < faltam; i++)
+	{
+		uint32_t k = pendentes[i];
+		for(j = i; j > 0 && setores[pendentes[j - 1]] > setores[k]; j--)
+		{
+			pendentes[j] = pendentes[j - 1];
+		}
+		pendentes[j] = k;
+	}
+	uint64_t inicio = microssegundos();
+	for(i = 0; i < faltam; i = j)
+	{
+		for(j = i + 1; j < faltam && setores[pendentes[j]] == setores[pendentes[j - 1]] + 1; j++);
+		pedido_disco(j - i);
+	}
+	for(i = 0; i < faltam; i++)
+	{
+		dccvmm_load_frame(setores[pendentes[i]], frames[pendentes[i]]);
+	}
+	if(faltam)
+	{
+		ESTAT_ADD(espera_disco_us, microssegundos() - inicio);
+	}
+}
+
+void disco_esvaziar(void){
+	pthread_mutex_lock(&trava_fila);
+	while(na_fila || no_lote)
+	{
+		pthread_cond_wait(&fila_andou, &trava_fila);
+	}
+	estatisticas_somar(&estat_fundo);
+	memset(&estat_fundo, 0, sizeof(estat_fundo));
+	pthread_mutex_unlock(&trava_fila);
+}
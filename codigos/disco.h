@@ -0,0 +1,36 @@
+#ifndef TPSO2_disco_h
+#define TPSO2_disco_h
+
+#include <inttypes.h>
+
+/* Estágio de E/S entre o sistema operacional e o disco do controlador (dccvmm_dump_frame e dccvmm_load_frame).
+ * Cada pedido ao disco paga uma latência simulada: o tempo de acesso mais o de transferência de cada setor do pedido.
+ * Sem gravação em segundo plano, cada gravação é feita na hora por quem a pede. Com ela, a gravação copia o frame num buffer e volta;
+ * uma thread de fundo grava os buffers em ordem de setor, juntando setores seguidos num só pedido. Leituras de setores que ainda
+ * estão na fila são atendidas pelo buffer, sem ir ao disco.
+ *
+ * Com o cache comprimido ligado, a gravação primeiro tenta guardar o frame comprimido (compressao.h) na memória, no lugar do setor.
+ * Frames que comprimem mal vão direto para o disco; quando o cache passa do orçamento, as páginas guardadas há mais tempo sem uso
+ * são gravadas no disco e saem dele. O setor continua reservado pelo sistema operacional como se a página estivesse no disco. */
+
+// Latência simulada de cada pedido ao disco, em microssegundos (padrão 0, sem espera):
+void disco_latencia(uint32_t acesso, uint32_t transferencia);
+// Liga a gravação em segundo plano:
+void disco_assincrono(int ligar);
+// Liga o cache comprimido com um orçamento em bytes (0 desliga). Frames cujo código passa de limite bytes vão para o disco (0 mantém o
+// limite atual, de meio frame):
+void disco_compressao(uint32_t bytes, uint32_t limite);
+// Grava o frame no setor; com gravação em segundo plano o frame pode ser reaproveitado assim que a função retorna:
+void disco_gravar(uint32_t frame, uint32_t setor);
+// Grava um setor do mapa de setores: vai sempre para o disco, sem passar pelo cache comprimido, cujos contadores descrevem só páginas de dados:
+void disco_gravar_mapa(uint32_t frame, uint32_t setor);
+// Lê os n setores para os respectivos frames, com um pedido por trecho de setores seguidos:
+void disco_ler(const uint32_t *setores, const uint32_t *frames, uint32_t n);
+// Avisa que o setor foi liberado: a cópia dele no cache comprimido não serve mais:
+void disco_descartar(uint32_t setor);
+// Grava no disco todas as páginas do cache comprimido e espera a fila esvaziar, para que o disco tenha o estado completo:
+void disco_descarregar(void);
+// Espera a fila de gravações esvaziar e soma na thread atual os contadores da thread de fundo:
+void disco_esvaziar(void);
+
+#endif
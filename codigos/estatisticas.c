@@ -0,0 +1,99 @@
+#include <string.h>
+
+#include "estatisticas.h"
+
+_Thread_local struct estatisticas estat;
+
+void estatisticas_zerar(void){
+	memset(&estat, 0, sizeof(estat));
+}
+
+void estatisticas_acumular(struct estatisticas *total, const struct estatisticas *parcial){
+	uint64_t pico = total->pico_frames_tabelas;
+	const uint64_t *origem = (const uint64_t *) parcial;
+	uint64_t *destino = (uint64_t *) total;
+	size_t i;
+	// Todos os campos são contadores uint64_t:
+	for(i = 0; i < sizeof(*total) / sizeof(uint64_t); i++)
+	{
+		destino[i] += origem[i];
+	}
+	total->pico_frames_tabelas = pico > parcial->pico_frames_tabelas ? pico : parcial->pico_frames_tabelas;
+}
+
+void estatisticas_somar(const struct estatisticas *parcial){
+	estatisticas_acumular(&estat, parcial);
+}
+
+static double taxa(uint64_t parte, uint64_t total){
+	return total ? (double) parte / total : 0.0;
+}
+
+// Um campo por linha, na ordem da struct, para que a saída seja fácil de comparar com diff entre execuções:
+#define CAMPO(nome) fprintf(saida, "  \"" #nome "\": %" PRIu64 ",\n", estat.nome)
+
+void estatisticas_json(FILE *saida){
+	uint64_t acessos = estat.leituras + estat.escritas;
+	fprintf(saida, "{\n");
+	CAMPO(leituras);
+	CAMPO(escritas);
+	CAMPO(percursos);
+	CAMPO(leituras_pte);
+	CAMPO(abortos);
+	CAMPO(tlb_acertos);
+	CAMPO(tlb_faltas);
+	CAMPO(tlb_invalidacoes);
+	CAMPO(trocas_tabela);
+	CAMPO(psc_acertos);
+	CAMPO(psc_faltas);
+	CAMPO(setores_lidos);
+	CAMPO(setores_gravados);
+	CAMPO(esperas_travas);
+	CAMPO(setores_descartados);
+	CAMPO(descartes_falhos);
+	CAMPO(allocs);
+	CAMPO(frees);
+	CAMPO(swaps);
+	CAMPO(faltas);
+	CAMPO(paginas_carregadas);
+	CAMPO(despejos);
+	CAMPO(escritas_paginas);
+	CAMPO(escritas_evitadas);
+	CAMPO(escritas_mapa_disco);
+	CAMPO(frames_alocados);
+	CAMPO(frames_liberados);
+	CAMPO(frames_tabelas);
+	CAMPO(pico_frames_tabelas);
+	CAMPO(paginas_grandes);
+	CAMPO(paginas_grandes_divididas);
+	CAMPO(forks);
+	CAMPO(tabelas_separadas);
+	CAMPO(copias_na_escrita);
+	CAMPO(paginas_zeradas);
+	CAMPO(leituras_pagina_zero);
+	CAMPO(paginas_alocadas);
+	CAMPO(paginas_residentes);
+	CAMPO(frames_ocupados);
+	CAMPO(pedidos_disco);
+	CAMPO(espera_disco_us);
+	CAMPO(leituras_da_fila);
+	CAMPO(leituras_antecipadas);
+	CAMPO(antecipadas_usadas);
+	CAMPO(paginas_na_troca);
+	CAMPO(paginas_comprimidas);
+	CAMPO(bytes_comprimidos);
+	CAMPO(recusadas_compressao);
+	CAMPO(expulsas_comprimidas);
+	CAMPO(leituras_comprimidas);
+	CAMPO(passos_mesclagem);
+	CAMPO(paginas_examinadas);
+	CAMPO(paginas_mescladas);
+	CAMPO(mescladas_no_zero);
+	CAMPO(frames_poupados_mesclagem);
+	fprintf(saida, "  \"taxa_acerto_tlb\": %.6f,\n", taxa(estat.tlb_acertos, estat.tlb_acertos + estat.tlb_faltas));
+	fprintf(saida, "  \"taxa_acerto_psc\": %.6f,\n", taxa(estat.psc_acertos, estat.psc_acertos + estat.psc_faltas));
+	fprintf(saida, "  \"leituras_pte_por_percurso\": %.6f,\n", taxa(estat.leituras_pte, estat.percursos));
+	fprintf(saida, "  \"taxa_percursos\": %.6f,\n", taxa(estat.percursos, acessos));
+	fprintf(saida, "  \"taxa_faltas_de_pagina\": %.6f\n", taxa(estat.paginas_carregadas, acessos));
+	fprintf(saida, "}\n");
+}
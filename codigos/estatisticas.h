@@ -0,0 +1,99 @@
+#ifndef TPSO2_estatisticas_h
+#define TPSO2_estatisticas_h
+
+#include <stdio.h>
+#include <inttypes.h>
+
+/* Contadores do sistema de memória, atualizados pelo controlador (vmm.c) e pelo sistema operacional (tp2.c).
+ * Os relatórios do fim da execução (dccvmm_tlb_report, os_relatorio e estatisticas_json) leem todos daqui.
+ * Cada thread conta na sua cópia de estat; quem cria as threads soma as cópias delas na sua com estatisticas_somar.
+ * Compilar com -DSEM_ESTATISTICAS tira os contadores do caminho dos acessos: as macros abaixo viram nada e os relatórios mostram zeros. */
+struct estatisticas {
+	// Controlador de memória:
+	uint64_t leituras;             // dccvmm_read
+	uint64_t escritas;             // dccvmm_write
+	uint64_t percursos;            // traduções que não estavam na TLB e percorreram a tabela de páginas
+	uint64_t leituras_pte;         // ptes lidos nos percursos (dccvmm_get_pte)
+	uint64_t abortos;              // acessos cancelados pelo sistema operacional com VM_ABORT
+	uint64_t tlb_acertos;
+	uint64_t tlb_faltas;
+	uint64_t tlb_invalidacoes;
+	uint64_t trocas_tabela;        // dccvmm_set_page_table
+	uint64_t psc_acertos;          // percursos que acharam no cache o pte da tabela 1 e leram só o da tabela 2
+	uint64_t psc_faltas;
+	uint64_t setores_lidos;        // dccvmm_load_frame
+	uint64_t setores_gravados;     // dccvmm_dump_frame, incluindo o mapa de setores
+	uint64_t esperas_travas;       // travas encontradas com outra thread (reprodução com várias threads)
+	uint64_t setores_descartados;  // setores livres cuja memória voltou ao hospedeiro (dccvmm_discard_sectors)
+	uint64_t descartes_falhos;     // dccvmm_discard_sectors recusados pelo hospedeiro
+	// Sistema operacional:
+	uint64_t allocs;
+	uint64_t frees;
+	uint64_t swaps;
+	uint64_t faltas;               // chamadas de os_pagefault
+	uint64_t paginas_carregadas;   // faltas resolvidas trazendo a página do disco
+	uint64_t despejos;             // páginas levadas para o disco
+	uint64_t escritas_paginas;     // setores de dados gravados no disco
+	uint64_t escritas_evitadas;    // despejos de páginas limpas que já tinham cópia no disco
+	uint64_t escritas_mapa_disco;  // setores do mapa do disco gravados
+	uint64_t frames_alocados;      // frames tirados do mapa de frames livres
+	uint64_t frames_liberados;     // frames devolvidos ao mapa de frames livres
+	uint64_t frames_tabelas;       // frames ocupados agora por tabelas de páginas 1 e 2
+	uint64_t pico_frames_tabelas;  // com várias threads, o maior pico entre elas
+	uint64_t paginas_grandes;      // blocos de 256 frames mapeados direto na tabela 1
+	uint64_t paginas_grandes_divididas; // páginas grandes trocadas por uma tabela 2 para liberar parte delas
+	uint64_t forks;
+	uint64_t tabelas_separadas;    // tabelas 2 compartilhadas por os_fork copiadas numa escrita
+	uint64_t copias_na_escrita;    // páginas compartilhadas copiadas numa escrita
+	uint64_t paginas_zeradas;      // frames zerados na primeira escrita de uma página alocada sem frame
+	uint64_t leituras_pagina_zero; // primeiros acessos de leitura mapeados no frame zero
+	// Contados por os_contar_paginas no fim da execução:
+	uint64_t paginas_alocadas;
+	uint64_t paginas_residentes;   // páginas alocadas com frame próprio na memória
+	uint64_t frames_ocupados;
+	// Estágio de E/S (disco.c):
+	uint64_t pedidos_disco;        // pedidos feitos ao disco; setores seguidos gravados ou lidos juntos contam como um
+	uint64_t espera_disco_us;      // tempo simulado em que o sistema operacional ficou parado esperando o disco
+	uint64_t leituras_da_fila;     // setores lidos do buffer de uma gravação ainda na fila
+	uint64_t leituras_antecipadas; // páginas trazidas do disco junto com a página da falta
+	uint64_t antecipadas_usadas;   // páginas antecipadas que chegaram a ser referenciadas
+	uint64_t paginas_na_troca;     // páginas do conjunto de trabalho trazidas do disco por os_swap
+	// Cache comprimido (disco.c):
+	uint64_t paginas_comprimidas;  // gravações guardadas comprimidas na memória em vez de ir ao disco
+	uint64_t bytes_comprimidos;    // soma dos tamanhos comprimidos dessas gravações
+	uint64_t recusadas_compressao; // gravações que foram ao disco por comprimir mal
+	uint64_t expulsas_comprimidas; // páginas frias gravadas no disco para abrir espaço no orçamento
+	uint64_t leituras_comprimidas; // setores lidos do cache comprimido
+	// Mesclagem de páginas iguais (tp2.c):
+	uint64_t passos_mesclagem;
+	uint64_t paginas_examinadas;   // páginas privadas e residentes encontradas nos frames examinados
+	uint64_t paginas_mescladas;    // páginas que passaram a compartilhar o frame de outra, liberando o seu
+	uint64_t mescladas_no_zero;    // páginas só de zeros mapeadas no frame zero
+	uint64_t frames_poupados_mesclagem; // contado por os_contar_paginas: referências a mais aos frames mesclados no fim da execução
+};
+
+extern _Thread_local struct estatisticas estat;
+
+#ifdef SEM_ESTATISTICAS
+#define ESTAT_INC(campo) do { } while(0)
+#define ESTAT_DEC(campo) do { } while(0)
+#define ESTAT_ADD(campo, n) do { } while(0)
+#define ESTAT_PICO(pico, campo) do { } while(0)
+#else
+#define ESTAT_INC(campo) (estat.campo++)
+#define ESTAT_DEC(campo) (estat.campo--)
+#define ESTAT_ADD(campo, n) (estat.campo += (n))
+// Guarda em "pico" o maior valor que "campo" já atingiu:
+#define ESTAT_PICO(pico, campo) do { if(estat.campo > estat.pico) estat.pico = estat.campo; } while(0)
+#endif
+
+// Zera todos os contadores:
+void estatisticas_zerar(void);
+// Soma em total os contadores de parcial:
+void estatisticas_acumular(struct estatisticas *total, const struct estatisticas *parcial);
+// Soma na cópia da thread atual os contadores de outra thread:
+void estatisticas_somar(const struct estatisticas *parcial);
+// Grava os contadores num objeto JSON, seguidos de algumas taxas derivadas:
+void estatisticas_json(FILE *saida);
+
+#endif
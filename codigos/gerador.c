@@ -0,0 +1,222 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "gerador.h"
+
+static const char *nomes_padroes[] = { "sequencial", "estride", "aleatorio", "zipf", "rotatividade", NULL };
+
+int gerador_padrao(const char *nome){
+	int i;
+	for(i = 0; nomes_padroes[i]; i++)
+	{
+		if(!strcmp(nome, nomes_padroes[i])) return i;
+	}
+	return -1;
+}
+
+// xorshift de 32 bits: a mesma semente gera sempre o mesmo arquivo, em qualquer máquina.
+static uint32_t sorteio;
+
+static uint32_t sortear(uint32_t limite){
+	sorteio ^= sorteio << 13;
+	sorteio ^= sorteio >> 17;
+	sorteio ^= sorteio << 5;
+	return sorteio % limite;
+}
+
+// Cada página usa sempre a mesma palavra, em posições diferentes de uma página para outra:
+static uint32_t endereco_da_pagina(uint32_t pagina){
+	return pagina << 8 | (pagina & 0xFF);
+}
+
+static void escrever(FILE *saida, uint32_t pagina){
+	uint32_t endereco = endereco_da_pagina(pagina);
+	fprintf(saida, "write %x %x\n", endereco, endereco ^ GERADOR_MARCA);
+}
+
+static void ler(FILE *saida, uint32_t pagina){
+	fprintf(saida, "read %x\n", endereco_da_pagina(pagina));
+}
+
+/* Páginas alocadas de um processo no padrão rotatividade. As alocadas ocupam lista[0..alocadas-1] e as livres o resto;
+ * posicao[p] é o índice da página p na lista, para tirar qualquer página de um lado e pôr no outro em tempo constante. */
+struct paginas_processo {
+	uint32_t *lista;
+	uint32_t *posicao;
+	uint32_t alocadas;
+};
+
+static void trocar_de_lado(struct paginas_processo *pp, uint32_t pagina, uint32_t destino){
+	uint32_t origem = pp->posicao[pagina];
+	uint32_t outra = pp->lista[destino];
+	pp->lista[destino] = pagina;
+	pp->posicao[pagina] = destino;
+	pp->lista[origem] = outra;
+	pp->posicao[outra] = origem;
+}
+
+/* Um passo do padrão rotatividade: às vezes libera uma página alocada ou aloca uma livre (escrevendo nela),
+ * e o resto do tempo acessa uma página alocada qualquer. Mantém entre metade e todas as páginas alocadas. */
+static void passo_rotatividade(FILE *saida, struct paginas_processo *pp, uint32_t paginas){
+	uint32_t pagina;
+	if(sortear(8) == 0)
+	{
+		if(pp->alocadas < paginas && (sortear(2) || pp->alocadas <= paginas / 2))
+		{
+			pagina = pp->lista[pp->alocadas + sortear(paginas - pp->alocadas)];
+			trocar_de_lado(pp, pagina, pp->alocadas++);
+			fprintf(saida, "alloc %x\n", pagina << 8);
+			escrever(saida, pagina);
+			return;
+		}
+		if(pp->alocadas > paginas / 2 + 1)
+		{
+			pagina = pp->lista[sortear(pp->alocadas)];
+			trocar_de_lado(pp, pagina, --pp->alocadas);
+			fprintf(saida, "free %x\n", pagina << 8);
+		}
+	}
+	pagina = pp->lista[sortear(pp->alocadas)];
+	if(sortear(4) == 0) escrever(saida, pagina);
+	else ler(saida, pagina);
+}
+
+// Distribuição acumulada de Zipf (expoente 1) sobre as posições 1..paginas:
+static double *montar_zipf(uint32_t paginas){
+	double *acumulada = malloc(paginas * sizeof(double));
+	double soma = 0.0;
+	uint32_t k;
+	if(!acumulada) return NULL;
+	for(k = 0; k < paginas; k++)
+	{
+		soma += 1.0 / (k + 1);
+		acumulada[k] = soma;
+	}
+	for(k = 0; k < paginas; k++)
+	{
+		acumulada[k] /= soma;
+	}
+	return acumulada;
+}
+
+static uint32_t sortear_zipf(const double *acumulada, uint32_t paginas){
+	double u = (double) sortear(1u << 30) / (1u << 30);
+	uint32_t inicio = 0, fim = paginas - 1;
+	while(inicio < fim)
+	{
+		uint32_t meio = (inicio + fim) / 2;
+		if(acumulada[meio] > u) fim = meio;
+		else inicio = meio + 1;
+	}
+	return inicio;
+}
+
+int gerar_trace(FILE *saida, const struct gerador *g){
+	uint32_t paginas = g->paginas, processos = g->processos;
+	uint32_t *cursor = NULL, *permutacao = NULL;
+	double *acumulada = NULL;
+	struct paginas_processo *pp = NULL;
+	uint32_t i, p, feitos, pid;
+	int erro = -1;
+
+	if(g->padrao < 0 || g->padrao > GERADOR_ROTATIVIDADE || paginas < 2 || paginas > GERADOR_MAX_PAGINAS
+			|| processos == 0 || processos > 0xFF)
+	{
+		fprintf(stderr, "gerador: padrao, paginas (2 a %u) ou processos (1 a 255) invalidos\n", GERADOR_MAX_PAGINAS);
+		return -1;
+	}
+	sorteio = g->semente ? g->semente : 1;
+	cursor = calloc(processos + 1, sizeof(uint32_t));
+	if(!cursor) goto fim;
+	if(g->padrao == GERADOR_ZIPF)
+	{
+		// As páginas mais populares ficam espalhadas pelo espaço de endereçamento, não todas na mesma tabela 2:
+		acumulada = montar_zipf(paginas);
+		permutacao = malloc(paginas * sizeof(uint32_t));
+		if(!acumulada || !permutacao) goto fim;
+		for(i = 0; i < paginas; i++)
+		{
+			permutacao[i] = i;
+		}
+		for(i = paginas - 1; i > 0; i--)
+		{
+			uint32_t j = sortear(i + 1), t = permutacao[i];
+			permutacao[i] = permutacao[j];
+			permutacao[j] = t;
+		}
+	}
+	if(g->padrao == GERADOR_ROTATIVIDADE)
+	{
+		pp = calloc(processos + 1, sizeof(*pp));
+		if(!pp) goto fim;
+		for(pid = 1; pid <= processos; pid++)
+		{
+			pp[pid].lista = malloc(paginas * sizeof(uint32_t));
+			pp[pid].posicao = malloc(paginas * sizeof(uint32_t));
+			if(!pp[pid].lista || !pp[pid].posicao) goto fim;
+			for(i = 0; i < paginas; i++)
+			{
+				pp[pid].lista[i] = pp[pid].posicao[i] = i;
+			}
+			pp[pid].alocadas = paginas;
+		}
+	}
+
+	fprintf(saida, "# tp2 -G %s,%u,%u,%u,%u\n", nomes_padroes[g->padrao], paginas, g->acessos, processos, g->semente);
+	for(pid = 1; pid <= processos; pid++)
+	{
+		fprintf(saida, "swap %u\n", pid);
+		fprintf(saida, "alloc_range 0 %u\n", paginas);
+		for(p = 0; p < paginas; p++)
+		{
+			escrever(saida, p);
+		}
+	}
+	for(feitos = 0, pid = processos; feitos < g->acessos; )
+	{
+		pid = pid % processos + 1;
+		if(processos > 1 || feitos == 0) fprintf(saida, "swap %u\n", pid);
+		for(i = 0; i < GERADOR_FATIA && feitos < g->acessos; i++, feitos++)
+		{
+			switch(g->padrao)
+			{
+				case GERADOR_SEQUENCIAL:
+					p = cursor[pid];
+					cursor[pid] = (p + 1) % paginas;
+					break;
+				case GERADOR_ESTRIDE:
+					p = cursor[pid];
+					cursor[pid] = (p + GERADOR_PASSO) % paginas;
+					break;
+				case GERADOR_ALEATORIO:
+					p = sortear(paginas);
+					break;
+				case GERADOR_ZIPF:
+					p = permutacao[sortear_zipf(acumulada, paginas)];
+					break;
+				default:
+					passo_rotatividade(saida, &pp[pid], paginas);
+					continue;
+			}
+			if(sortear(4) == 0) escrever(saida, p);
+			else ler(saida, p);
+		}
+	}
+	erro = fflush(saida) != 0;
+
+fim:
+	if(erro < 0) fprintf(stderr, "gerador: memoria insuficiente\n");
+	if(pp)
+	{
+		for(pid = 1; pid <= processos; pid++)
+		{
+			free(pp[pid].lista);
+			free(pp[pid].posicao);
+		}
+		free(pp);
+	}
+	free(cursor);
+	free(permutacao);
+	free(acumulada);
+	return erro;
+}
@@ -0,0 +1,36 @@
+#ifndef TPSO2_gerador_h
+#define TPSO2_gerador_h
+
+#include <stdio.h>
+#include <inttypes.h>
+
+/* Gerador de arquivos de acessos sintéticos (opção -G de main), para medir o simulador com cargas maiores que teste.txt.
+ * Cada processo aloca "paginas" páginas a partir do endereço 0 e escreve uma palavra em cada; depois os processos se revezam em fatias
+ * de GERADOR_FATIA acessos (com um swap a cada troca) até somar "acessos" leituras e escritas. Cada página usa sempre a mesma palavra
+ * e o valor escrito é sempre endereço ^ GERADOR_MARCA, então toda leitura tem um resultado conhecido. */
+#define GERADOR_FATIA 64
+#define GERADOR_PASSO 17        // páginas puladas a cada acesso no padrão estride
+#define GERADOR_MARCA 0x5a5a
+#define GERADOR_MAX_PAGINAS 0x10000 // o espaço de endereçamento de um processo (24 bits)
+
+// Padrões de acesso dentro de cada processo:
+#define GERADOR_SEQUENCIAL   0
+#define GERADOR_ESTRIDE      1
+#define GERADOR_ALEATORIO    2 // páginas sorteadas com a mesma chance
+#define GERADOR_ZIPF         3 // a página de posição k é sorteada com chance proporcional a 1/k
+#define GERADOR_ROTATIVIDADE 4 // acessos aleatórios misturados com frees e allocs de páginas sorteadas
+
+struct gerador {
+	int padrao;
+	uint32_t paginas;   // por processo
+	uint32_t acessos;   // total, somando todos os processos
+	uint32_t processos; // ids de 1 a processos
+	uint32_t semente;
+};
+
+// Procura o padrão pelo nome (sequencial, estride, aleatorio, zipf ou rotatividade); retorna -1 se não existe:
+int gerador_padrao(const char *nome);
+// Escreve o arquivo de acessos no formato texto. Retorna 0 em caso de sucesso:
+int gerar_trace(FILE *saida, const struct gerador *g);
+
+#endif
@@ -0,0 +1,78 @@
+#!/bin/sh
+# Gera os arquivos de acessos sinteticos usados nas medidas citadas no
+# historico do projeto. A saida e sempre a mesma: o sorteio usa um gerador
+# proprio (Park-Miller) em vez do rand do awk, que muda de uma versao para outra.
+#
+# uso: ./gerar_acessos.sh mp2|teste64 > arquivo.txt
+#
+# mp2: 32 processos com 200 paginas cada. Cada processo aloca as suas paginas
+#      e escreve uma palavra em cada; depois, em 4 rodadas, cada processo le 150
+#      das suas paginas, sorteadas, escreve na palavra seguinte e a le de novo.
+#      Toda palavra escrita guarda endereco ^ 0x5a5a.
+# teste64: o teste.txt aumentado para 64 processos. Cada processo aloca 100
+#      paginas a partir de 0x123400 e escreve (processo * 1000 + pagina) ^ 0x5a5a
+#      na segunda palavra de cada uma; depois, em 4 rodadas, cada processo le
+#      essas palavras de novo.
+
+case "$1" in
+mp2|teste64) ;;
+*) echo "uso: $0 mp2|teste64" >&2; exit 1 ;;
+esac
+
+awk -v caso="$1" '
+function sortear(n) { semente = (semente * 16807) % 2147483647; return semente % n }
+function escrever(a) { printf "write %x %x\n", a, xor(a, 23130) }
+# xor de 16 bits sem depender de extensoes do awk:
+function xor(a, b,   r, p) {
+	r = 0
+	for (p = 1; p <= 32768; p *= 2) {
+		if ((int(a / p) % 2) != (int(b / p) % 2)) r += p
+	}
+	return r + int(a / 65536) * 65536
+}
+BEGIN {
+	semente = 7
+	if (caso == "mp2") {
+		P = 32; N = 200
+		for (p = 1; p <= P; p++) {
+			print "swap " p
+			for (i = 0; i < N; i++) {
+				a = p * 65536 + i * 256
+				printf "alloc %x\n", a
+				escrever(a + i % 200)
+			}
+		}
+		for (r = 0; r < 4; r++) {
+			for (p = 1; p <= P; p++) {
+				print "swap " p
+				# as 150 primeiras posicoes de um embaralhamento de Fisher-Yates:
+				for (i = 0; i < N; i++) ordem[i] = i
+				for (i = 0; i < 150; i++) {
+					j = i + sortear(N - i)
+					t = ordem[i]; ordem[i] = ordem[j]; ordem[j] = t
+					a = p * 65536 + ordem[i] * 256 + ordem[i] % 200
+					printf "read %x\n", a
+					escrever(a + 1)
+					printf "read %x\n", a + 1
+				}
+			}
+		}
+	}
+	if (caso == "teste64") {
+		P = 64; N = 100
+		for (p = 1; p <= P; p++) {
+			print "swap " p
+			for (i = 0; i < N; i++) {
+				a = 1192960 + i * 256
+				printf "alloc %x\n", a
+				printf "write %x %x\n", a + 1, xor(p * 1000 + i, 23130)
+			}
+		}
+		for (r = 0; r < 4; r++) {
+			for (p = 1; p <= P; p++) {
+				print "swap " p
+				for (i = 0; i < N; i++) printf "read %x\n", 1192960 + i * 256 + 1
+			}
+		}
+	}
+}'
@@ -0,0 +1,113 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "log.h"
+
+#define TAMANHO_BUFFER_TEXTO (1 << 20)
+#define EVENTOS_BUFFER (1 << 16)
+
+int log_nivel = NIVEL_ACESSOS;
+
+static FILE *saida = NULL; // NULL = stdout
+static int fechado = 0;    // depois de log_fechar os eventos são descartados
+static int formato_saida = FORMATO_TEXTO;
+static char *buffer_texto = NULL;
+// Os eventos binários são acumulados aqui e gravados com um único fwrite por buffer cheio.
+// Com várias threads, o buffer é protegido por trava_eventos; nos formatos texto cada fprintf já é atômico:
+static struct log_evento *eventos = NULL;
+static uint32_t total_eventos = 0;
+static pthread_mutex_t trava_eventos = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *nomes_eventos[] = { "", "read", "write", "phy_read", "phy_write", "tabela" };
+
+int log_abrir(int nivel, const char *arquivo, int formato){
+	log_nivel = nivel;
+	formato_saida = formato;
+	saida = stdout;
+	if(arquivo && !(saida = fopen(arquivo, formato == FORMATO_BIN ? "wb" : "w"))) {
+		perror(arquivo);
+		saida = stdout;
+		return -1;
+	}
+	if(formato == FORMATO_BIN) {
+		eventos = malloc(EVENTOS_BUFFER * sizeof(*eventos));
+		if(!eventos) return -1;
+		fwrite(LOG_MAGICA, 1, strlen(LOG_MAGICA), saida);
+	} else {
+		buffer_texto = malloc(TAMANHO_BUFFER_TEXTO);
+		if(buffer_texto) setvbuf(saida, buffer_texto, _IOFBF, TAMANHO_BUFFER_TEXTO);
+		if(formato == FORMATO_CSV && log_nivel >= NIVEL_ACESSOS) fprintf(saida, "evento,endereco,fisico,dado\n");
+	}
+	atexit(log_fechar);
+	return 0;
+}
+
+static void esvaziar_eventos(void){
+	if(total_eventos) fwrite(eventos, sizeof(*eventos), total_eventos, saida);
+	total_eventos = 0;
+}
+
+void log_fechar(void){
+	if(!saida) return;
+	if(eventos) {
+		esvaziar_eventos();
+		free(eventos);
+		eventos = NULL;
+	}
+	fflush(saida);
+	if(saida != stdout) fclose(saida);
+	saida = NULL;
+	fechado = 1;
+	// O buffer só pode ser liberado depois que a saída que o usa foi fechada; stdout continua usando-o até o fim do programa.
+}
+
+void log_evento(uint32_t tipo, uint32_t endereco, uint32_t fisico, uint32_t dado){
+	FILE *f = saida ? saida : stdout;
+	// Sem isto, um evento depois do fim iria para stdout ou, no formato binário, para o buffer já liberado:
+	if(fechado) return;
+	switch(formato_saida) {
+	case FORMATO_BIN:
+		pthread_mutex_lock(&trava_eventos);
+		eventos[total_eventos].tipo = tipo;
+		eventos[total_eventos].endereco = endereco;
+		eventos[total_eventos].fisico = fisico;
+		eventos[total_eventos].dado = dado;
+		if(++total_eventos == EVENTOS_BUFFER) esvaziar_eventos();
+		pthread_mutex_unlock(&trava_eventos);
+		break;
+	case FORMATO_CSV:
+		fprintf(f, "%s,%x,%x,%x\n", nomes_eventos[tipo], endereco, fisico, dado);
+		break;
+	default:
+		switch(tipo) {
+		case EVENTO_READ:
+			fprintf(f, "vmm %x phy %x read %x\n", endereco, fisico, dado);
+			break;
+		case EVENTO_WRITE:
+			fprintf(f, "vmm %x phy %x write %x\n", endereco, fisico, dado);
+			break;
+		case EVENTO_PHY_READ:
+			fprintf(f, "vmm phy %x read %x\n", fisico, dado);
+			break;
+		case EVENTO_PHY_WRITE:
+			fprintf(f, "vmm phy %x write %x\n", fisico, dado);
+			break;
+		case EVENTO_TABELA:
+			fprintf(f, "vmm using pagetable in frame %x\n", fisico);
+			break;
+		}
+	}
+}
+
+void log_mensagem(const char *formato, ...){
+	va_list args;
+	FILE *f = (formato_saida == FORMATO_TEXTO && saida) ? saida : (formato_saida == FORMATO_TEXTO ? stdout : stderr);
+	va_start(args, formato);
+	vfprintf(f, formato, args);
+	va_end(args);
+}
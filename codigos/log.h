@@ -0,0 +1,51 @@
+#ifndef TPSO2_log_h
+#define TPSO2_log_h
+
+#include <inttypes.h>
+
+// Níveis de registro, escolhidos na execução (opção -l de main):
+#define NIVEL_NADA      0 // nenhuma saída
+#define NIVEL_RESUMO    1 // só os relatórios do fim da execução
+#define NIVEL_ACESSOS   2 // um registro por acesso à memória, troca de tabela e erro (padrão)
+#define NIVEL_DEPURACAO 3 // e as mensagens de depuração do sistema operacional
+
+// Formatos da saída de registros (opção -f de main):
+#define FORMATO_TEXTO 0 // as linhas "vmm %x phy %x read %x" de sempre, para comparação com diff
+#define FORMATO_CSV   1 // evento,endereco,fisico,dado em hexadecimal
+#define FORMATO_BIN   2 // cabeçalho LOG_MAGICA seguido de struct log_evento na ordem de bytes da máquina
+
+#define LOG_MAGICA "TPSO2LOG"
+
+// Eventos registrados no nível NIVEL_ACESSOS:
+#define EVENTO_READ      1
+#define EVENTO_WRITE     2
+#define EVENTO_PHY_READ  3
+#define EVENTO_PHY_WRITE 4
+#define EVENTO_TABELA    5 // troca da tabela de páginas corrente; o frame vai em "fisico"
+
+struct log_evento {
+	uint32_t tipo;
+	uint32_t endereco;
+	uint32_t fisico;
+	uint32_t dado;
+};
+
+extern int log_nivel;
+
+// Abre a saída de registros; arquivo NULL usa stdout. Retorna 0 em caso de sucesso:
+int log_abrir(int nivel, const char *arquivo, int formato);
+// Esvazia o buffer e fecha a saída (também chamada na saída do programa):
+void log_fechar(void);
+void log_evento(uint32_t tipo, uint32_t endereco, uint32_t fisico, uint32_t dado);
+// Mensagens de texto: vão para a saída de registros no formato texto e para stderr nos demais formatos:
+void log_mensagem(const char *formato, ...);
+
+// O nível é testado antes da chamada para que registros desligados custem só uma comparação:
+#define LOG_ACESSO(tipo, endereco, fisico, dado) \
+	do { if(log_nivel >= NIVEL_ACESSOS) log_evento(tipo, endereco, fisico, dado); } while(0)
+#define LOG_ERRO(...) \
+	do { if(log_nivel >= NIVEL_ACESSOS) log_mensagem(__VA_ARGS__); } while(0)
+#define LOG_DEPURACAO(...) \
+	do { if(log_nivel >= NIVEL_DEPURACAO) log_mensagem(__VA_ARGS__); } while(0)
+
+#endif
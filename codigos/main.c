@@ -1,57 +1,410 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
 
 #include "vmm.h"
+#include "tp2.h"
+#include "substituicao.h"
+#include "bench.h"
+#include "trace.h"
+#include "log.h"
+#include "estatisticas.h"
+#include "disco.h"
+#include "gerador.h"
+#include "analise.h"
 
 extern void os_init(void);
 extern void os_alloc(uint32_t addr);
 extern void os_free(uint32_t addr);
 extern void os_swap(uint32_t pid);
 
-#define BUFSZ 1024
-
-int main(int argc, char **argv)
+static void uso(const char *prog)
 {
-	FILE *fd = fopen(argv[1], "r");
-	char line[BUFSZ];
+	fprintf(stderr, "uso: %s [-b] [-g] [-z] [-d imagem [-r]] [-a paginas] [-C kb[,limite]] [-L acesso[,transferencia]] [-w] [-m frames[,intervalo]] [-A curva[,frames]] [-j threads] [-t entradas[,vias[,lru|fifo|aleatoria]]]\n", prog);
+	fprintf(stderr, "       [-P entradas] [-p fifo|clock|lru|wsclock[,janela]]\n");
+	fprintf(stderr, "       [-l nada|resumo|acessos|depuracao] [-o saida] [-f texto|csv|bin] [-s json] arquivo\n");
+	fprintf(stderr, "     %s -c saida arquivo\n", prog);
+	fprintf(stderr, "     %s -B alocador|alocador-threads|paginas-grandes[,rodadas]\n", prog);
+	fprintf(stderr, "     %s -G sequencial|estride|aleatorio|zipf|rotatividade[,paginas[,acessos[,processos[,semente]]]]\n", prog);
+	fprintf(stderr, "  -b  o arquivo de acessos esta no formato binario\n");
+	fprintf(stderr, "  -g  aloca trechos de 256 paginas alinhadas em paginas grandes\n");
+	fprintf(stderr, "  -z  da frame as paginas alocadas so no primeiro acesso (leituras usam a pagina zero)\n");
+	fprintf(stderr, "  -d  usa o arquivo imagem como disco e grava o estado do sistema em imagem.estado no fim\n");
+	fprintf(stderr, "  -r  retoma a execucao gravada em imagem e imagem.estado em vez de comecar vazio\n");
+	fprintf(stderr, "  -a  grava as paginas despejadas em segundo plano e traz do disco ate paginas paginas seguintes em cada falta\n");
+	fprintf(stderr, "  -C  guarda as paginas despejadas comprimidas em ate kb KB de memoria antes do disco; vao direto\n");
+	fprintf(stderr, "      para o disco as que passam de limite bytes comprimidas (padrao 512)\n");
+	fprintf(stderr, "  -L  latencia simulada do disco em microssegundos: por pedido e por setor (padrao 0,0)\n");
+	fprintf(stderr, "  -w  traz de volta de uma vez as paginas usadas pelo processo na ultima vez em que ele rodou (swap)\n");
+	fprintf(stderr, "  -m  a cada intervalo swaps (padrao 1), procura paginas iguais em frames frames e as mescla num frame\n");
+	fprintf(stderr, "      somente para leitura, copiado na primeira escrita\n");
+	fprintf(stderr, "  -A  grava em curva (- para stdout) a curva de faltas LRU de todos os tamanhos de memoria em csv e\n");
+	fprintf(stderr, "      compara as faltas do otimo de Belady com frames frames com as da politica (padrao: todos os frames livres)\n");
+	fprintf(stderr, "  -j  divide os processos entre threads, cada uma com a sua CPU\n");
+	fprintf(stderr, "  -c  converte o arquivo de acessos texto para o formato binario\n");
+	fprintf(stderr, "  -t  configura a TLB (padrao 64,4,lru; 0 desliga)\n");
+	fprintf(stderr, "  -P  entradas do cache de ptes de nivel 1 (padrao %d, potencia de 2; 0 desliga)\n", DCCVMM_PSC_ENTRIES);
+	fprintf(stderr, "  -p  politica de substituicao de paginas (padrao clock)\n");
+	fprintf(stderr, "  -l  nivel de registro (padrao acessos)\n");
+	fprintf(stderr, "  -o  grava os registros em saida em vez de stdout\n");
+	fprintf(stderr, "  -f  formato dos registros (padrao texto)\n");
+	fprintf(stderr, "  -s  grava os contadores do sistema de memoria em json no fim (- para stdout, exceto com -f bin sem -o)\n");
+	fprintf(stderr, "  -B  executa um micro-benchmark em vez de um arquivo de acessos\n");
+	fprintf(stderr, "  -G  escreve em stdout um arquivo de acessos sintetico (padrao 4096 paginas, 100000 acessos, 1 processo, semente 1)\n");
+	exit(EXIT_FAILURE);
+}
+
+static char *imagem = NULL;
+static char estado[4096];
+static int retomar = 0;
+static char *curva = NULL;
+static uint32_t frames_analise = 0;
 
+/* Inicia o disco e o sistema operacional. Com -r o sistema volta ao estado
+ * gravado no fim da execucao anterior em vez de comecar vazio. */
+static void iniciar(void)
+{
 	dccvmm_init();
-	os_init();
-	
-
-	while(fgets(line, BUFSZ, fd)) {
-		unsigned address;
-		if(line[0] == '#') continue;
-
-		if(!strncmp(line, "alloc", 5)) {
-			sscanf(line, "alloc %x\n", &address);
-			os_alloc(address);
-		} else if(!strncmp(line, "free", 4)) {
-			sscanf(line, "free %x\n", &address);
-			os_free(address);
-		} else if(!strncmp(line, "read", 4)) {
-			sscanf(line, "read %x\n", &address);
-			dccvmm_read(address);
-		} else if(!strncmp(line, "write", 5)) {
-			unsigned data;
-			sscanf(line, "write %x %x\n", &address, &data);
-			dccvmm_write(address, data);
-		} else if(!strncmp(line, "swap", 4)) {
-			unsigned pid;
-			sscanf(line, "swap %u\n", &pid);
-			os_swap(pid);
-		}
+	if(!retomar) {
+		os_init();
+	} else if(os_retomar(estado)) {
+		exit(EXIT_FAILURE);
 	}
+	/* sem frames em -A, a analise usa os frames livres para as paginas de dados */
+	if(curva && !frames_analise) frames_analise = frames_livres_dados();
+}
+
+/* Le a configuracao da TLB no formato entradas[,vias[,politica]]. */
+static void config_tlb(const char *prog, char *arg)
+{
+	unsigned entradas = 64, vias = 4;
+	int politica = TLB_LRU;
+	char *tok = strtok(arg, ",");
+	if(tok) entradas = strtoul(tok, NULL, 0);
+	if((tok = strtok(NULL, ","))) vias = strtoul(tok, NULL, 0);
+	if((tok = strtok(NULL, ","))) {
+		if(!strcmp(tok, "lru")) politica = TLB_LRU;
+		else if(!strcmp(tok, "fifo")) politica = TLB_FIFO;
+		else if(!strcmp(tok, "aleatoria")) politica = TLB_ALEATORIA;
+		else uso(prog);
+	}
+	if(entradas == 0) {
+		dccvmm_tlb_config(0, 0, politica);
+		return;
+	}
+	if(vias == 0 || vias > entradas || entradas % vias
+			|| ((entradas / vias) & (entradas / vias - 1))) {
+		fprintf(stderr, "TLB invalida: entradas/vias deve ser potencia de 2\n");
+		exit(EXIT_FAILURE);
+	}
+	dccvmm_tlb_config(entradas, vias, politica);
+}
+
+/* Le a latencia do disco no formato acesso[,transferencia]. */
+static void config_latencia(char *arg)
+{
+	char *tok = strtok(arg, ",");
+	unsigned acesso = tok ? strtoul(tok, NULL, 0) : 0;
+	unsigned transferencia = (tok = strtok(NULL, ",")) ? strtoul(tok, NULL, 0) : 0;
+	disco_latencia(acesso, transferencia);
+}
+
+/* Le o cache comprimido no formato kb[,limite]. */
+static void config_compressao(char *arg)
+{
+	char *tok = strtok(arg, ",");
+	unsigned kb = tok ? strtoul(tok, NULL, 0) : 0;
+	unsigned limite = (tok = strtok(NULL, ",")) ? strtoul(tok, NULL, 0) : 0;
+	disco_compressao(kb * 1024, limite);
+}
+
+/* Le a mesclagem de paginas no formato frames[,intervalo]. */
+static void config_mesclagem(char *arg)
+{
+	char *tok = strtok(arg, ",");
+	unsigned frames = tok ? strtoul(tok, NULL, 0) : 0;
+	unsigned intervalo = (tok = strtok(NULL, ",")) ? strtoul(tok, NULL, 0) : 1;
+	os_mesclagem(frames, intervalo);
+}
+
+/* Le a politica de substituicao no formato nome[,janela]. */
+static void config_politica(const char *prog, char *arg)
+{
+	char *nome = strtok(arg, ",");
+	char *tok = strtok(NULL, ",");
+	const struct politica_substituicao *p = nome ? procurar_politica(nome) : NULL;
+	if(!p) uso(prog);
+	if(tok) configurar_janela_wsclock(strtoul(tok, NULL, 0));
+	os_politica(p);
+}
+
+/* Procura nome na lista de nomes terminada por NULL e retorna sua posicao. */
+static int opcao(const char *prog, const char *nome, const char **nomes)
+{
+	int i;
+	for(i = 0; nomes[i]; i++) {
+		if(!strcmp(nome, nomes[i])) return i;
+	}
+	uso(prog);
+	return -1;
+}
+
+/* Executa o micro-benchmark pedido em -B no formato nome[,rodadas]. */
+static void bench(const char *prog, char *arg)
+{
+	char *nome = strtok(arg, ",");
+	char *tok = strtok(NULL, ",");
+	unsigned rodadas = tok ? strtoul(tok, NULL, 0) : 1000;
 
-	fclose(fd);
+	dccvmm_init();
+	os_init();
+	if(nome && !strcmp(nome, "alocador")) bench_alocador(rodadas);
+	else if(nome && !strcmp(nome, "alocador-threads")) bench_alocador_threads(rodadas);
+	else if(nome && !strcmp(nome, "paginas-grandes")) bench_paginas_grandes(rodadas);
+	else uso(prog);
 	exit(EXIT_SUCCESS);
 }
 
+/* Escreve em stdout o arquivo de acessos pedido em -G no formato
+ * padrao[,paginas[,acessos[,processos[,semente]]]]. */
+static void gerar(const char *prog, char *arg)
+{
+	struct gerador g = { 0, 4096, 100000, 1, 1 };
+	char *nome = strtok(arg, ",");
+	char *tok;
+	if(!nome || (g.padrao = gerador_padrao(nome)) < 0) uso(prog);
+	if((tok = strtok(NULL, ","))) g.paginas = strtoul(tok, NULL, 0);
+	if((tok = strtok(NULL, ","))) g.acessos = strtoul(tok, NULL, 0);
+	if((tok = strtok(NULL, ","))) g.processos = strtoul(tok, NULL, 0);
+	if((tok = strtok(NULL, ","))) g.semente = strtoul(tok, NULL, 0);
+	exit(gerar_trace(stdout, &g) ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+static double segundos(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* Tempo de parede da reproducao, vazao e pico de memoria residente do
+ * simulador; make bench le esta linha. */
+static void relatorio_execucao(double tempo)
+{
+	struct rusage uso_recursos;
+	getrusage(RUSAGE_SELF, &uso_recursos);
+	fprintf(stderr, "execucao: tempo %.3f s acessos por segundo %.0f pico de memoria %ld KB\n",
+		tempo, tempo > 0 ? (estat.leituras + estat.escritas) / tempo : 0.0, uso_recursos.ru_maxrss);
+}
 
+/* Le a analise de distancias de reuso no formato curva[,frames]. */
+static void config_analise(char *arg)
+{
+	char *tok = strtok(arg, ",");
+	curva = tok ? tok : "-";
+	if((tok = strtok(NULL, ","))) frames_analise = strtoul(tok, NULL, 0);
+	analise_ligar();
+}
 
+/* Grava a curva de faltas no arquivo pedido em -A ("-" e stdout) e o resumo da
+ * analise em stderr. Retorna 0 em caso de sucesso. */
+static int gravar_analise(void)
+{
+	FILE *fd = stdout;
+	int erro;
+	if(strcmp(curva, "-")) {
+		fd = fopen(curva, "w");
+		if(!fd) {
+			perror(curva);
+			return 1;
+		}
+	} else {
+		log_fechar();
+	}
+	erro = analise_relatorio(fd, frames_analise, estat.paginas_carregadas);
+	if(fd != stdout) return fclose(fd) != 0 || erro;
+	return fflush(fd) != 0 || erro;
+}
 
+/* Grava o resumo em json no arquivo pedido em -s ("-" e stdout). Retorna 0 em
+ * caso de sucesso. */
+static int gravar_json(const char *arquivo)
+{
+	FILE *fd = stdout;
+	if(strcmp(arquivo, "-")) {
+		fd = fopen(arquivo, "w");
+		if(!fd) {
+			perror(arquivo);
+			return 1;
+		}
+	} else {
+		/* os registros que ainda estao no buffer saem antes do json */
+		log_fechar();
+	}
+	estatisticas_json(fd);
+	if(fd != stdout) return fclose(fd) != 0;
+	return fflush(fd) != 0;
+}
 
+int main(int argc, char **argv)
+{
+	int opt;
+	char *benchmark = NULL;
+	char *gerado = NULL;
+	double inicio, tempo;
+	char *convertido = NULL;
+	int binario = 0;
+	unsigned threads = 0;
+	unsigned entradas_psc;
+	int erro;
+	static const char *niveis[] = { "nada", "resumo", "acessos", "depuracao", NULL };
+	static const char *formatos[] = { "texto", "csv", "bin", NULL };
+	int nivel = NIVEL_ACESSOS, formato = FORMATO_TEXTO;
+	char *saida = NULL;
+	char *json = NULL;
 
+	dccvmm_tlb_config(64, 4, TLB_LRU);
+	while((opt = getopt(argc, argv, "bgzwrm:d:a:A:C:L:c:j:t:P:p:l:o:f:s:B:G:")) != -1) {
+		switch(opt) {
+		case 'b':
+			binario = 1;
+			break;
+		case 'g':
+			os_paginas_grandes(1);
+			break;
+		case 'z':
+			os_alocacao_preguicosa(1);
+			break;
+		case 'd':
+			imagem = optarg;
+			break;
+		case 'r':
+			retomar = 1;
+			break;
+		case 'a':
+			disco_assincrono(1);
+			os_antecipacao(strtoul(optarg, NULL, 0));
+			break;
+		case 'A':
+			config_analise(optarg);
+			break;
+		case 'C':
+			config_compressao(optarg);
+			break;
+		case 'L':
+			config_latencia(optarg);
+			break;
+		case 'w':
+			os_conjunto_trabalho(1);
+			break;
+		case 'm':
+			config_mesclagem(optarg);
+			break;
+		case 'j':
+			threads = strtoul(optarg, NULL, 0);
+			if(threads == 0 || threads >= DCCVMM_MAX_CPUS) {
+				fprintf(stderr, "threads deve estar entre 1 e %d\n", DCCVMM_MAX_CPUS - 1);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'c':
+			convertido = optarg;
+			break;
+		case 't':
+			config_tlb(argv[0], optarg);
+			break;
+		case 'P':
+			entradas_psc = strtoul(optarg, NULL, 0);
+			if(entradas_psc & (entradas_psc - 1)) {
+				fprintf(stderr, "o cache de ptes de nivel 1 deve ter potencia de 2 entradas\n");
+				exit(EXIT_FAILURE);
+			}
+			dccvmm_psc_config(entradas_psc);
+			break;
+		case 'p':
+			config_politica(argv[0], optarg);
+			break;
+		case 'l':
+			nivel = opcao(argv[0], optarg, niveis);
+			break;
+		case 'o':
+			saida = optarg;
+			break;
+		case 'f':
+			formato = opcao(argv[0], optarg, formatos);
+			break;
+		case 's':
+			json = optarg;
+			break;
+		case 'B':
+			benchmark = optarg;
+			break;
+		case 'G':
+			gerado = optarg;
+			break;
+		default:
+			uso(argv[0]);
+		}
+	}
+	if(retomar && !imagem) uso(argv[0]);
+	/* com -f bin e sem -o os registros binarios vao para stdout, onde -s -
+	 * grava o json */
+	if(formato == FORMATO_BIN && !saida && json && !strcmp(json, "-")) {
+		fprintf(stderr, "-f bin sem -o nao pode ser usado com -s -: os dois iriam para stdout\n");
+		exit(EXIT_FAILURE);
+	}
+	if(curva && threads) {
+		fprintf(stderr, "a analise de distancias de reuso precisa da reproducao com uma so thread\n");
+		exit(EXIT_FAILURE);
+	}
+	if(imagem) {
+		snprintf(estado, sizeof(estado), "%s.estado", imagem);
+		dccvmm_disk_file(imagem, retomar);
+	}
+	if(benchmark) bench(argv[0], benchmark);
+	if(gerado) gerar(argv[0], gerado);
+	if(optind >= argc) uso(argv[0]);
+	if(log_abrir(nivel, saida, formato)) exit(EXIT_FAILURE);
+	inicio = segundos();
 
+	if(threads && !convertido) {
+		iniciar();
+		erro = reproduzir_paralelo(argv[optind], binario, threads);
+	} else if(binario) {
+		iniciar();
+		erro = reproduzir_binario(argv[optind]);
+	} else {
+		FILE *fd = fopen(argv[optind], "r");
+		if(!fd) {
+			perror(argv[optind]);
+			exit(EXIT_FAILURE);
+		}
+		if(convertido) {
+			erro = converter_trace(fd, convertido);
+			fclose(fd);
+			exit(erro ? EXIT_FAILURE : EXIT_SUCCESS);
+		}
+		iniciar();
+		erro = reproduzir_texto(fd);
+		fclose(fd);
+	}
 
+	os_sincronizar();
+	tempo = segundos() - inicio;
+	os_contar_paginas();
+	if(imagem && os_salvar(estado)) erro = 1;
+	if(log_nivel >= NIVEL_RESUMO) {
+		dccvmm_tlb_report();
+		os_relatorio();
+		relatorio_execucao(tempo);
+	}
+	if(json && gravar_json(json)) erro = 1;
+	if(curva && gravar_analise()) erro = 1;
+	dccvmm_shutdown();
+	exit(erro ? EXIT_FAILURE : EXIT_SUCCESS);
+}
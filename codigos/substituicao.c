@@ -0,0 +1,263 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "substituicao.h"
+#include "tp2.h"
+#include "vmm.h"
+
+/*****************************************************************************
+ * FIFO: despeja a página carregada há mais tempo.
+ ****************************************************************************/
+// Fila duplamente encadeada de frames na ordem de carga (0 = fim da fila, o frame 0 nunca é de dados):
+static uint32_t fila_proximo[NUMFRAMES];
+static uint32_t fila_anterior[NUMFRAMES];
+static uint32_t fila_inicio;
+static uint32_t fila_fim;
+
+static void fifo_iniciar(void){
+	memset(fila_proximo, 0, sizeof(fila_proximo));
+	memset(fila_anterior, 0, sizeof(fila_anterior));
+	fila_inicio = fila_fim = 0;
+}
+
+static void fifo_carregada(uint32_t frame){
+	fila_anterior[frame] = fila_fim;
+	fila_proximo[frame] = 0;
+	if(fila_fim)
+	{
+		fila_proximo[fila_fim] = frame;
+	}
+	else
+	{
+		fila_inicio = frame;
+	}
+	fila_fim = frame;
+}
+
+static void fifo_liberada(uint32_t frame){
+	if(fila_anterior[frame])
+	{
+		fila_proximo[fila_anterior[frame]] = fila_proximo[frame];
+	}
+	else
+	{
+		fila_inicio = fila_proximo[frame];
+	}
+	if(fila_proximo[frame])
+	{
+		fila_anterior[fila_proximo[frame]] = fila_anterior[frame];
+	}
+	else
+	{
+		fila_fim = fila_anterior[frame];
+	}
+	fila_proximo[frame] = fila_anterior[frame] = 0;
+}
+
+static uint32_t fifo_escolher_vitima(void){
+	return fila_inicio;
+}
+
+const struct politica_substituicao politica_fifo = {
+	"fifo", fifo_iniciar, fifo_carregada, fifo_liberada, fifo_escolher_vitima
+};
+
+/*****************************************************************************
+ * Clock (segunda chance): o ponteiro percorre os frames em ordem circular e
+ * despeja o primeiro cuja página não foi referenciada desde a última volta.
+ ****************************************************************************/
+static uint32_t ponteiro;
+
+static void clock_iniciar(void){
+	ponteiro = 0;
+}
+
+static void nada(uint32_t frame){
+	(void) frame;
+}
+
+static uint32_t clock_escolher_vitima(void){
+	uint32_t n;
+	// Na pior das hipóteses a primeira volta limpa todos os bits de referência e a segunda encontra a vítima:
+	for(n = 0; n < 2 * NUMFRAMES; n++)
+	{
+		ponteiro = (ponteiro + 1) % NUMFRAMES;
+		uint32_t *pte = pte_do_frame(ponteiro);
+		if(pte == NULL)
+		{
+			continue;
+		}
+		if(*pte & PTE_ACCESSED)
+		{
+			limpar_referencia(ponteiro);
+			continue;
+		}
+		return ponteiro;
+	}
+	return 0;
+}
+
+const struct politica_substituicao politica_clock = {
+	"clock", clock_iniciar, nada, nada, clock_escolher_vitima
+};
+
+/*****************************************************************************
+ * LRU aproximado por envelhecimento (aging): a cada escolha de vítima o
+ * contador de cada página é deslocado para a direita e recebe o bit de
+ * referência no bit mais significativo. A página de menor contador é a que
+ * está há mais tempo sem ser usada.
+ ****************************************************************************/
+static uint8_t idade[NUMFRAMES];
+
+static void lru_iniciar(void){
+	memset(idade, 0, sizeof(idade));
+	ponteiro = 0;
+}
+
+static void lru_carregada(uint32_t frame){
+	idade[frame] = 0x80;
+}
+
+static uint32_t lru_escolher_vitima(void){
+	uint32_t n;
+	uint32_t vitima = 0;
+	// O percurso começa depois da última vítima para que empates não favoreçam sempre os frames mais baixos:
+	for(n = 0; n < NUMFRAMES; n++)
+	{
+		ponteiro = (ponteiro + 1) % NUMFRAMES;
+		uint32_t *pte = pte_do_frame(ponteiro);
+		if(pte == NULL)
+		{
+			continue;
+		}
+		idade[ponteiro] >>= 1;
+		if(*pte & PTE_ACCESSED)
+		{
+			idade[ponteiro] |= 0x80;
+			limpar_referencia(ponteiro);
+		}
+		if(vitima == 0 || idade[ponteiro] < idade[vitima])
+		{
+			vitima = ponteiro;
+		}
+	}
+	if(vitima)
+	{
+		ponteiro = vitima;
+	}
+	return vitima;
+}
+
+const struct politica_substituicao politica_lru = {
+	"lru", lru_iniciar, lru_carregada, nada, lru_escolher_vitima
+};
+
+/*****************************************************************************
+ * WS-Clock: como o clock, mas uma página só é despejada se estiver fora do
+ * conjunto de trabalho, isto é, sem referência há mais de "janela" unidades
+ * de tempo virtual. Entre as páginas velhas, as limpas são preferidas porque
+ * já têm cópia no disco. As velhas modificadas encontradas no caminho são
+ * gravadas (até MAX_ESCRITAS_WSCLOCK por escolha) e continuam na memória,
+ * para que um despejo futuro as encontre limpas.
+ ****************************************************************************/
+#define MAX_ESCRITAS_WSCLOCK 8
+
+static uint64_t tempo_virtual;
+static uint64_t ultimo_uso[NUMFRAMES];
+static uint32_t janela = NUMFRAMES / 4;
+
+void configurar_janela_wsclock(uint32_t j){
+	janela = j;
+}
+
+static void wsclock_iniciar(void){
+	memset(ultimo_uso, 0, sizeof(ultimo_uso));
+	tempo_virtual = 0;
+	ponteiro = 0;
+}
+
+static void wsclock_carregada(uint32_t frame){
+	ultimo_uso[frame] = ++tempo_virtual;
+}
+
+static uint32_t wsclock_escolher_vitima(void){
+	uint32_t n;
+	uint32_t escritas = 0;
+	uint32_t velha_suja = 0; // primeira página fora do conjunto de trabalho que estava modificada
+	uint32_t limpa = 0; // primeira página limpa e sem referência
+	uint32_t mais_antiga = 0;
+	tempo_virtual++;
+	for(n = 0; n < NUMFRAMES; n++)
+	{
+		ponteiro = (ponteiro + 1) % NUMFRAMES;
+		uint32_t *pte = pte_do_frame(ponteiro);
+		if(pte == NULL)
+		{
+			continue;
+		}
+		if(*pte & PTE_ACCESSED)
+		{
+			limpar_referencia(ponteiro);
+			ultimo_uso[ponteiro] = tempo_virtual;
+		}
+		else if(!(*pte & PTE_DIRTY))
+		{
+			if(tempo_virtual - ultimo_uso[ponteiro] > janela)
+			{
+				return ponteiro;
+			}
+			if(limpa == 0)
+			{
+				limpa = ponteiro;
+			}
+		}
+		else if(tempo_virtual - ultimo_uso[ponteiro] > janela)
+		{
+			if(escritas < MAX_ESCRITAS_WSCLOCK && limpar_pagina(ponteiro))
+			{
+				escritas++;
+			}
+			if(velha_suja == 0)
+			{
+				velha_suja = ponteiro;
+			}
+		}
+		if(mais_antiga == 0 || ultimo_uso[ponteiro] < ultimo_uso[mais_antiga])
+		{
+			mais_antiga = ponteiro;
+		}
+	}
+	// Nenhuma página limpa fora do conjunto de trabalho:
+	if(velha_suja)
+	{
+		return ponteiro = velha_suja;
+	}
+	if(limpa)
+	{
+		return ponteiro = limpa;
+	}
+	if(mais_antiga)
+	{
+		ponteiro = mais_antiga;
+	}
+	return mais_antiga;
+}
+
+const struct politica_substituicao politica_wsclock = {
+	"wsclock", wsclock_iniciar, wsclock_carregada, nada, wsclock_escolher_vitima
+};
+
+const struct politica_substituicao *procurar_politica(const char *nome){
+	static const struct politica_substituicao *politicas[] = {
+		&politica_fifo, &politica_clock, &politica_lru, &politica_wsclock
+	};
+	uint32_t i;
+	for(i = 0; i < sizeof(politicas) / sizeof(politicas[0]); i++)
+	{
+		if(!strcmp(politicas[i]->nome, nome))
+		{
+			return politicas[i];
+		}
+	}
+	return NULL;
+}
@@ -0,0 +1,28 @@
+#ifndef TPSO2_substituicao_h
+#define TPSO2_substituicao_h
+
+#include <inttypes.h>
+
+// Política de substituição de páginas usada por despejar_pagina quando a memória de dados enche.
+// O sistema operacional avisa a política sempre que um frame de dados passa a conter uma página (alocação ou retorno do disco)
+// e sempre que deixa de conter (liberação ou despejo). A política lê e limpa os bits de referência pelos ptes de pte_do_frame.
+struct politica_substituicao {
+	const char *nome;
+	void (*iniciar)(void);
+	void (*carregada)(uint32_t frame);
+	void (*liberada)(uint32_t frame);
+	// Retorna o frame a ser despejado, ou 0 se nenhum frame puder ser despejado:
+	uint32_t (*escolher_vitima)(void);
+};
+
+extern const struct politica_substituicao politica_fifo;
+extern const struct politica_substituicao politica_clock;
+extern const struct politica_substituicao politica_lru;
+extern const struct politica_substituicao politica_wsclock;
+
+// Procura uma política pelo nome (fifo, clock, lru, wsclock); retorna NULL se não existir:
+const struct politica_substituicao *procurar_politica(const char *nome);
+// Janela do conjunto de trabalho do WS-Clock, medida em páginas carregadas e despejos:
+void configurar_janela_wsclock(uint32_t janela);
+
+#endif
@@ -1,8 +1,15 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "tp2.h"
 #include "vmm.h"
+#include "substituicao.h"
+#include "log.h"
+#include "estatisticas.h"
+#include "disco.h"
 
 #define TAMANHO_FRAME 0x100
 #define INICIO_MEMORIA_SISTEMA 0x0 // endereço do primeiro frame
@@ -15,19 +22,162 @@
 #define FIM_MEMORIA_SISTEMA 0xFFF // 0xFFF = 0d4095 endereço de memoria
 #define INICIO_MEMORIA_PROCESSOS 0x1000 // 0x1000 = 0d4096 endereço de memoria
 #define FIM_MEMORIA_PROCESSOS 0xFFFFF // 0xFFFFF = 1048575 endereço de memoria
+#define TOTAL_LINHAS_SISTEMA (FIM_TABELA_SISTEMA - INICIO_TABELA_SISTEMA + 1)
+#define MAX_PID 0xFF // o id do processo ocupa os 8 bits mais significativos da entrada na tabela de sistema
+// Os endereços da memória de sistema são contínuos nos 16 primeiros frames: a palavra "linha" fica no frame linha/256.
+#define PALAVRA_SISTEMA(linha) (__frames[(linha)/TAMANHO_FRAME].words[(linha)%TAMANHO_FRAME])
+// Uma página que foi para o disco continua com PTE_VALID, perde PTE_INMEM e guarda o número do setor nos 20 bits menos significativos do pte:
+#define PTESETOR(pte) (pte & 0x000FFFFF)
+// Bit de PTEUSER que marca, sem PTE_RW, os ptes de tabelas 1 e 2 compartilhados por os_fork: a primeira escrita causa uma falta e a cópia.
+#define PTE_COW 0x04000000
+// O disco tem 0x100000 setores; os 0x80 primeiros guardam o mapa de setores ocupados (um bit por setor):
+#define NUMSETORES 0x100000
+#define SETORES_MAPA 0x80
+#define PALAVRAS_MAPA_SETORES (SETORES_MAPA * TAMANHO_FRAME)
+// Quantidade de alterações no mapa de setores residente antes que os setores do mapa modificados sejam gravados no disco:
+#define LOTE_MAPA_SETORES 64
 
 
-uint32_t procurar_frame_livre_dados(void);
 uint32_t procurar_frame_sistema(void);
+void reconstruir_indice_sistema(void);
+void liberar_linha_sistema(uint32_t pid);
 uint32_t procurar_frame_tabela_2(uint32_t virtaddr);
 uint32_t dump_setor_livre (uint32_t);
-void restaurar_setor (uint32_t setor, uint32_t frame);
+uint32_t alocar_setor (void);
+void liberar_setor (uint32_t setor);
+void sincronizar_mapa_setores (void);
+uint32_t obter_frame_livre(void);
+uint32_t despejar_pagina(void);
+static void nova_tabela(uint32_t frame);
+static uint32_t reservar_frames(uint32_t *frames, uint32_t quantos);
+static int mapear_pagina_grande(uint32_t pagina);
+static int dividir_pagina_grande(uint32_t tabela1, uint32_t indice);
+static void devolver_bloco(uint32_t base);
+static void invalidar_frame(uint32_t frame);
+static uint32_t local_do_dono(uint32_t frame);
+static uint32_t seguinte_no_anel(uint32_t local, uint32_t inicio);
+static void entrar_no_anel(uint32_t existente, uint32_t novo);
+static uint32_t sair_do_anel(uint32_t local);
+static void deixar_frame_compartilhado(uint32_t frame, uint32_t local);
+static void mapear_carregada(uint32_t local, uint32_t pagina, uint32_t frame, uint32_t setor);
+static int setor_pedido(uint32_t setor, const uint32_t *setores, uint32_t n);
+static void conferir_antecipada(uint32_t frame, uint32_t pte);
+static int separar_tabela2(uint32_t tabela1, uint32_t indice);
+static int copiar_pagina(uint32_t address);
+static int tocar_pagina(uint32_t address, uint32_t perms);
+static void registrar_conjunto(uint32_t pid, uint32_t tabela1);
+static void carregar_conjunto(uint32_t pid, uint32_t tabela1);
+static void passo_mesclagem(void);
+struct lote_frames;
+static uint32_t descartar_pagina(uint32_t frame_tabela2, uint32_t indice);
+static void esvaziar_lote(struct lote_frames *lote);
+static void desmontar_paginas(uint32_t tabela1, uint32_t primeira, uint32_t ultima, struct lote_frames *lote);
+static void liberar_tabela1(uint32_t pid, uint32_t tabela1);
 
-static uint32_t id_processos = 1;
+// Cada thread (CPU) executa um processo por vez; as funções do sistema operacional agem sobre o processo corrente da thread que as chama.
+static _Thread_local uint32_t id_processos = 1;
+/* As estruturas compartilhadas entre as threads (tabelas de páginas, mapa reverso, tabela de sistema, mapa de setores, política de
+ * substituição) ficam todas sob a trava das tabelas de páginas do controlador (dccvmm_pt_lock), que o percurso da tabela já segura quando
+ * chama os_pagefault. Não há travas menores: o sistema operacional inteiro roda com uma thread por vez, e só os acertos na TLB correm em
+ * paralelo. O mapa de frames livres não tem trava e é alterado com operações atômicas, porque os caches das threads o usam sem ela. */
+// Cursor do next-fit: palavra do mapa de frames livres onde a última alocação parou.
+static uint32_t cursor_frames_livres = INICIO_FRAMES_LIVRES;
+// Quantidade de bits zerados no mapa de frames livres (os frames nos caches das threads não contam):
+static uint32_t total_frames_livres = 0;
+// Cache de frames de cada thread: frames já reservados no mapa de frames livres, entregues e recebidos sem tocar no mapa compartilhado.
+// Só as threads que chamam os_iniciar_thread usam cache; a thread principal aloca direto do mapa, sempre na mesma ordem.
+#define CACHE_FRAMES 32 // capacidade do cache de cada thread
+#define LOTE_FRAMES 16 // frames movidos de uma vez entre o cache e o mapa
+static _Thread_local struct {
+	uint32_t frames[CACHE_FRAMES];
+	uint32_t total;
+	int ativo;
+} cache_frames;
+// Índice da tabela de sistema: linha ocupada por cada processo (0 = processo sem linha).
+// A tabela de sistema na memória continua sendo a fonte da verdade; este índice é reconstruído a partir dela.
+static uint16_t linha_do_processo[MAX_PID + 1];
+// Pilha de linhas livres da tabela de sistema:
+static uint16_t linhas_livres[TOTAL_LINHAS_SISTEMA];
+static uint32_t total_linhas_livres = 0;
+// Mapa reverso dos frames de dados: tabela de páginas 2 e número da página virtual que ocupam cada frame (tabela2 == 0: o frame não pode ser despejado).
+// As tabelas de páginas nunca vão para o disco.
+static struct {
+	uint32_t tabela2;
+	uint32_t pagina;
+} dono_do_frame[NUMFRAMES];
+// Tabela de páginas 1 dona de cada tabela 2, indexada pelo frame da tabela 2; 0 enquanto a tabela 2 é compartilhada por os_fork.
+static uint16_t dono_da_tabela2[NUMFRAMES];
+// Referências a mais a cada frame, além da primeira: entradas de tabelas 1 que apontam para a mesma tabela 2 ou ptes do anel de
+// compartilhamento que apontam para o mesmo frame de dados.
+static uint16_t referencias[NUMFRAMES];
+/* Anel de compartilhamento: os ptes de tabelas 2 que compartilham uma página (cópias de separar_tabela2 ou páginas mescladas) formam uma
+ * lista circular, indexada pelo local do pte (frame da tabela 2 << 8 | índice na tabela 2), com o local do próximo pte do anel (0 = pte
+ * não compartilhado). Os ptes de um anel apontam todos para o mesmo frame ou, depois de um despejo, todos para o mesmo setor; o setor só
+ * é liberado quando o último pte sai do anel. O frame compartilhado continua na política de substituição, com o dono num dos ptes do
+ * anel, e o despejo grava um setor só e atualiza todos os ptes. O vetor começa zerado e cada pte sai do anel antes de ser apagado. */
+#define LOCAL(tabela2, indice) ((tabela2) << 8 | (indice))
+#define PTE_DO_LOCAL(local) (&__frames[(local) >> 8].words[(local) & 0xFF])
+static uint32_t anel_compartilhamento[NUMFRAMES * TAMANHO_FRAME];
+// Entrada da tabela 1 que aponta para cada tabela 2, indexada pelo frame da tabela 2; dá a página virtual dos ptes de um anel:
+static uint8_t indice_da_tabela2[NUMFRAMES];
+// Com páginas grandes ligadas, os_alloc_range mapeia cada trecho de 256 páginas alinhadas num bloco de frames seguidos (PTE_HUGE):
+static int paginas_grandes = 0;
+// Com alocação preguiçosa ligada, as páginas alocadas ficam só com PTE_VALID | PTE_RW e setor 0, sem frame, até o primeiro acesso:
+// uma leitura mapeia a página no frame zero, compartilhado por todas e somente para leitura, e uma escrita recebe um frame zerado.
+static int alocacao_preguicosa = 0;
+static uint32_t frame_zero = 0x0;
+// Leitura antecipada: numa falta de página do disco, as próximas "antecipacao" páginas da mesma tabela 2 que estão no disco vêm junto,
+// para frames livres (nunca com despejo). Os frames marcados em antecipada ainda não tiveram o bit de referência conferido.
+#define MAX_ANTECIPACAO 32
+static uint32_t antecipacao = 0;
+static uint8_t antecipada[NUMFRAMES];
+// Conjunto de trabalho de cada processo, anotado quando ele sai da CPU: as páginas residentes com o bit de referência ligado (a política
+// de substituição desliga os bits periodicamente). Quando o processo volta, as páginas do conjunto despejadas nesse meio-tempo são trazidas
+// do disco de uma vez, em vez de uma falta de página por vez.
+#define MAX_CONJUNTO 256
+static int conjunto_trabalho = 0;
+static struct {
+	uint16_t paginas[MAX_CONJUNTO];
+	uint16_t total;
+} conjunto[MAX_PID + 1];
+/* Mesclagem de páginas iguais: a cada "intervalo_mesclagem" chamadas de os_swap, um passo examina os próximos "frames_por_passo" frames.
+ * Uma página privada cujo conteúdo não mudou desde o passo anterior (mesma soma) é procurada no índice pela soma; se o frame do índice
+ * tem o mesmo conteúdo, as duas páginas passam a compartilhar esse frame somente para leitura, como depois de os_fork, e a primeira
+ * escrita faz a cópia em copiar_pagina. Com alocação preguiçosa, páginas só de zeros vão para o frame zero. O índice guarda um frame
+ * por posição e pode estar desatualizado: o frame é conferido antes de cada mesclagem. Frames marcados em mesclado foram compartilhados
+ * aqui e podem receber mais páginas enquanto tiverem referências. */
+#define TAMANHO_INDICE_MESCLAGEM 4096
+static uint32_t frames_por_passo = 0;
+static uint32_t intervalo_mesclagem = 1;
+static uint32_t trocas_desde_passo = 0;
+static uint32_t cursor_mesclagem = 0;
+static uint32_t soma_do_frame[NUMFRAMES];
+static uint16_t indice_mesclagem[TAMANHO_INDICE_MESCLAGEM];
+static uint8_t mesclado[NUMFRAMES];
+// Quantidade de entradas não nulas de cada tabela de páginas, indexada pelo frame da tabela: a tabela está vazia quando o contador chega a zero.
+static uint16_t entradas_em_uso[NUMFRAMES];
+// Frames liberados na desmontagem de tabelas de páginas, devolvidos ao mapa de frames livres de uma vez:
+struct lote_frames {
+	uint32_t frames[TAMANHO_FRAME];
+	uint32_t total;
+};
+// Política que escolhe o frame a ser despejado quando a memória enche:
+static const struct politica_substituicao *politica = &politica_clock;
+// Setor do disco com uma cópia da página que está no frame (0 = sem cópia; o setor 0 guarda o mapa do disco e nunca contém dados).
+// A cópia só está atualizada enquanto o pte não tiver PTE_DIRTY.
+static uint32_t setor_do_frame[NUMFRAMES];
+// Cópia residente do mapa de setores do disco. Os setores do mapa alterados desde a última gravação ficam marcados como sujos
+// e são gravados em lote, em vez de cada alocação ler e gravar o setor do mapa no disco.
+static uint32_t mapa_setores[PALAVRAS_MAPA_SETORES];
+static uint8_t setor_mapa_sujo[SETORES_MAPA];
+static uint32_t alteracoes_mapa_setores = 0;
+static uint32_t cursor_setores = 0; // palavra do mapa onde a próxima alocação de setor começa; volta para trás a cada setor liberado abaixo dela
+static uint32_t total_setores_livres = 0;
 
 
 void os_init(void) {	
 	uint32_t i;
+	estatisticas_zerar();
 	// Inicializa os a memória de sistema:
 	// tentar usar a funcao dccvmm_zero
 	for(i=0; i<16; i++)
@@ -43,348 +193,1937 @@ void os_init(void) {
 	*/
 	// Inicializa a estrutura que identifica os frames livres, informando que os 16 primeiros frames estão ocupados (pelo sistema):
 	__frames[0].words[0] |= 0xFFFF;
+	cursor_frames_livres = INICIO_FRAMES_LIVRES;
+	total_frames_livres = 0;
+	for(i = INICIO_FRAMES_LIVRES; i <= FIM_FRAMES_LIVRES; i++)
+	{
+		total_frames_livres += 32 - __builtin_popcount(__frames[0].words[i]);
+	}
+	reconstruir_indice_sistema();
+	memset(dono_do_frame, 0, sizeof(dono_do_frame));
+	memset(dono_da_tabela2, 0, sizeof(dono_da_tabela2));
+	memset(referencias, 0, sizeof(referencias));
+	memset(entradas_em_uso, 0, sizeof(entradas_em_uso));
+	memset(setor_do_frame, 0, sizeof(setor_do_frame));
+	memset(antecipada, 0, sizeof(antecipada));
+	memset(conjunto, 0, sizeof(conjunto));
+	politica->iniciar();
 	// Inicializando a variável __pagetable:
 	__pagetable = 0x0;
 	// Inicializando o contador do id de processos: Em nosso sistema operacional, não é aceito um processo com ID zero
     id_processos = 1;
 
 
-    // Inicializar o disco:
-    dccvmm_init();
+    // O disco já foi iniciado por quem chama os_init (dccvmm_init).
 
-    // Usa frame 1 para inicializar o disco
+    // Inicializa o mapa de setores: os primeiros 128 setores guardam o próprio mapa
     uint32_t j;
-    for (j = 0; j < 0x80; j++) {
-        __frames[1].words[j] = 0xFFFF; // Primeiros 128 frames indicam o uso do disco
-    }
-
-    dccvmm_dump_frame(0x1, 0x0); // Dump do frame 2 para o setor 0
-
-    dccvmm_zero(1); // Reset no frame 1
-
-    for (j = 0x1; j < 0x100; j++) {
-        dccvmm_dump_frame(0x1, j); //
+    memset(mapa_setores, 0, sizeof(mapa_setores));
+    for (j = 0; j < SETORES_MAPA / 0x20; j++) {
+        mapa_setores[j] = 0xFFFFFFFF;
     }
-
+    memset(setor_mapa_sujo, 1, sizeof(setor_mapa_sujo));
+    cursor_setores = 0;
+    total_setores_livres = NUMSETORES - SETORES_MAPA;
+    sincronizar_mapa_setores();
+	// O frame zero nunca tem dono nem vai para o disco:
+	frame_zero = alocacao_preguicosa ? procurar_frame_livre_dados() : 0x0;
+	if(frame_zero)
+	{
+		dccvmm_zero(frame_zero);
+	}
 }
 
 uint32_t os_pagefault(uint32_t address, uint32_t perms, uint32_t pte){
+	ESTAT_INC(faltas);
 	// Verifica se há uma entrada válida na tabela de páginas:
 	// acho que tenho que pensar melhor nesse caso para quando chamar o os_alloc pois neste caso
 	if(pte < 0x10)
 	{
-		printf("Erro de segmentação: Não existe entrada válida na tabela de páginas para o endereço virtual 0x%X\n", address);
-		printf("(RETIRAR ESTE PRINT) pte: 0x%X\n", pte); 
+		LOG_ERRO("Erro de segmentação: Não existe entrada válida na tabela de páginas para o endereço virtual 0x%X\n", address);
+		LOG_DEPURACAO("pte: 0x%X\n", pte); 
 		return VM_ABORT;
 	}
+	// Página alocada que nunca foi usada (alocação preguiçosa):
+	if((pte & PTE_VALID) && !(pte & PTE_INMEM) && PTESETOR(pte) == 0x0)
+	{
+		return tocar_pagina(address, perms) ? EXIT_SUCCESS : VM_ABORT;
+	}
+	// A página é válida mas foi despejada para o disco: traz a página de volta para um frame livre.
+	// Somente ptes da tabela 2 saem da memória, então a página é a do endereço na tabela de páginas atual.
+	if((pte & PTE_VALID) && !(pte & PTE_INMEM))
+	{
+		uint32_t frame = obter_frame_livre();
+		if(frame == 0x0)
+		{
+			LOG_ERRO("Erro: Não há frame livre para trazer do disco a página do endereço virtual 0x%X\n", address);
+			return VM_ABORT;
+		}
+		uint32_t frame_tabela2 = PTEFRAME(__frames[__pagetable].words[PTE1OFF(address)]);
+		uint32_t *tabela2 = __frames[frame_tabela2].words;
+		uint32_t setores[1 + MAX_ANTECIPACAO], frames[1 + MAX_ANTECIPACAO], indices[1 + MAX_ANTECIPACAO];
+		uint32_t n = 1, k;
+		setores[0] = PTESETOR(pte);
+		frames[0] = frame;
+		indices[0] = PTE2OFF(address);
+		for(k = PTE2OFF(address) + 1; k < TAMANHO_FRAME && k <= PTE2OFF(address) + antecipacao; k++)
+		{
+			if(!(tabela2[k] & PTE_VALID) || (tabela2[k] & PTE_INMEM) || PTESETOR(tabela2[k]) == 0x0)
+			{
+				continue;
+			}
+			// Duas páginas mescladas da mesma tabela 2 estão no mesmo setor, que vem uma vez só:
+			if(anel_compartilhamento[LOCAL(frame_tabela2, k)] && setor_pedido(PTESETOR(tabela2[k]), setores, n))
+			{
+				continue;
+			}
+			frames[n] = procurar_frame_livre_dados();
+			if(frames[n] == 0x0)
+			{
+				break;
+			}
+			setores[n] = PTESETOR(tabela2[k]);
+			indices[n++] = k;
+		}
+		disco_ler(setores, frames, n);
+		for(k = 0; k < n; k++)
+		{
+			mapear_carregada(LOCAL(frame_tabela2, indices[k]), (PAGENUM(address) & 0xFF00) | indices[k], frames[k], setores[k]);
+			antecipada[frames[k]] = (k > 0);
+		}
+		ESTAT_INC(paginas_carregadas);
+		ESTAT_ADD(leituras_antecipadas, n - 1);
+		// O controlador não refaz o acesso: uma escrita numa página compartilhada que estava no disco já recebe a cópia aqui.
+		if((perms & PTE_RW) && (pte & PTE_COW))
+		{
+			return copiar_pagina(address) ? EXIT_SUCCESS : VM_ABORT;
+		}
+		return EXIT_SUCCESS;
+	}
+	// Escrita numa página compartilhada por os_fork: se a tabela 2 ainda é compartilhada, a falta vem do pte da tabela 1 e o processo ganha
+	// uma tabela 2 própria; senão, vem do pte da tabela 2 e o processo ganha uma cópia da página.
+	if((perms & PTE_RW) && (pte & PTE_COW))
+	{
+		if(__frames[__pagetable].words[PTE1OFF(address)] & PTE_COW)
+		{
+			if(!separar_tabela2(__pagetable, PTE1OFF(address)))
+			{
+				LOG_ERRO("Erro: Não há memória para separar a tabela de páginas compartilhada do endereço virtual 0x%X\n", address);
+				return VM_ABORT;
+			}
+			return EXIT_SUCCESS;
+		}
+		return copiar_pagina(address) ? EXIT_SUCCESS : VM_ABORT;
+	}
 	// Verifica se as permissões estão compatíveis:
 	// acho que tenho que pensar melhor nesse caso
-	if(perms != (pte & 0xF00000))
+	if((pte & perms) != perms)
 	{
-		printf("Erro de segmentação: Erro de permissões\n");
+		LOG_ERRO("Erro de segmentação: Erro de permissões\n");
 		//return VM_ABORT;
 	}
 	return EXIT_SUCCESS;
 }
 
-void os_alloc(uint32_t virtaddr) {
-	printf("\n\n(RETIRAR ESTE PRINT) Função \"os_alloc\"\n");
+// Encontra ou cria a tabela de páginas 1 do processo atual e atualiza a linha dele na tabela de sistema. Retorna o frame da tabela 1 ou 0 se faltar memória:
+static uint32_t obter_tabela1(uint32_t virtaddr) {
+	uint32_t pte = 0x0;
+	uint32_t linha_livre_ts = 0x0; // linha livre tabela de sistema para alocar a tabela 1
+	uint32_t frame_tabela1 = 0x0; // frame livre tabela de página 1
+	// Procura por uma linha livre na memória de sistema para alocar os dados da tabela 1:
+	linha_livre_ts = procurar_frame_sistema();
+	// Verifica se existe uma entrada na tabela de sistema para o processo atual. Se não existir, verifica se há espaço disponível para alocar as informações do processo atual.
+	if(linha_livre_ts == 0x0)
+	{
+		LOG_DEPURACAO("Não houve espaço de MEMÓRIA DE SISTEMA para alocar a TABELA 1\n");
+		// Podemos colocar aqui uma condição para o caso de não achar um frame livre e implementar a parte 5
+		return 0x0;
+	}
+	// Não existiam informações na tabela de sistema para o processo atual:
+	if(__pagetable == 0x0)
+	{
+		// Procura por um frame livre na memoria de dados para alocar a tabela de página 1:
+		frame_tabela1 = obter_frame_livre();
+		if(frame_tabela1) nova_tabela(frame_tabela1);
+	}
+	// Existia informações na tabela de sistema para o processo atual:
+	else
+	{
+		frame_tabela1 = PTEFRAME(__frames[linha_livre_ts/256].words[linha_livre_ts%256]);
+	}
+	if(frame_tabela1 == 0x0)
+	{
+		LOG_DEPURACAO("Não houve espaço de MEMÓRIA DE DADOS para alocar a TABELA 1\n");
+		// Podemos colocar aqui uma condição para o caso de não achar um frame livre e implementar a parte 5
+		return 0x0;
+	}
+	LOG_DEPURACAO("A TABELA 1 está no FRAME 0x%X da TABELA DE DADOS\n", frame_tabela1);
+	// Se for uma tabela de ágina 1 que estiver entrando agora no mapa de memória, seu frame deve ser atribuido à variável global __pagetable:
+	if(__pagetable == 0x0)
+	{
+		dccvmm_set_page_table(frame_tabela1);
+	}
+	// Compõe a entrada na tabela de página do sistema operacional: id do processo (8bits) + permissões (4 bits) + 8 bits mais significativos do endereço virtual + frame livre (12 bits) = 8 + 4 + 8 + 12 = 32 bits.
+	// Só a tabela de sistema guarda o id do processo: nas tabelas 1 e 2 os bits PTEUSER marcam páginas grandes e compartilhadas.
+	pte = pte | (id_processos << 24) | PTE_RW | PTE_INMEM | PTE_VALID | (virtaddr & 0x00FF0000) >> 4 | __pagetable;
+	// Preenche tabela de sistema com os dados da tabela de página 1:
+	LOG_DEPURACAO("Inserindo os DADOS da TABELA 1 na TABELA DE SISTEMA...\n");
+	__frames[linha_livre_ts/256].words[linha_livre_ts%256] = pte;
+	LOG_DEPURACAO("__frames[0x%X].words[0x%X] = 0x%X;\n", linha_livre_ts/256, linha_livre_ts%256, __frames[linha_livre_ts/256].words[linha_livre_ts%256]);
+	return frame_tabela1;
+}
+
+static void alocar_pagina(uint32_t virtaddr) {
+	LOG_DEPURACAO("\n\nFunção \"os_alloc\"\n");
+	ESTAT_INC(allocs);
 	// Verifica se endereço virtual é múltiplo do tamanho do frame:
 	if(virtaddr%TAMANHO_FRAME)
 	{
-		printf("Erro de segmentação: Não foi possível alocar o endereço 0x%X pois ele não é múltiplo do tamanho do frame 0x%X\n", virtaddr, TAMANHO_FRAME);
+		LOG_ERRO("Erro de segmentação: Não foi possível alocar o endereço 0x%X pois ele não é múltiplo do tamanho do frame 0x%X\n", virtaddr, TAMANHO_FRAME);
+		return;
+	}
+	if(virtaddr > 0xFFFFFF)
+	{
+		LOG_ERRO("Erro de segmentação: Não foi possível alocar o endereço 0x%X pois ele está fora do espaço de endereçamento\n", virtaddr);
 		return;
 	}
 	uint32_t pte = 0x0;
-	uint32_t mascara;
-	uint32_t linha_livre_ts = 0x0; // linha livre tabela de sistema para alocar a tabela 1
 	uint32_t frame_tabela1 = 0x0; // frame livre tabela de página 1
 	uint32_t frame_tabela2 = 0x0; // frame livre tabela de página 1
 	uint32_t frame_livre_dado = 0x0; // frame livre onde vai o dado propriamente dito
-	printf("(RETIRAR ESTE PRINT) Endereço virtual:  0x%X\n", virtaddr);
+	// configura as permissões para ler e escrever, diz que está em memória e que é valido:
+	uint32_t perms = PTE_RW | PTE_INMEM | PTE_VALID;
+	LOG_DEPURACAO("Endereço virtual:  0x%X\n", virtaddr);
 	
-	// Procura por uma linha livre na memória de sistema para alocar os dados da tabela 1:
-	linha_livre_ts = procurar_frame_sistema();
-	// Verifica se existe uma entrada na tabela de sistema para o processo atual. Se não existir, verifica se há espaço disponível para alocar as informações do processo atual.
-	if(linha_livre_ts)
+	frame_tabela1 = obter_tabela1(virtaddr);
+	if(frame_tabela1)
 	{
-		// Não existiam informações na tabela de sistema para o processo atual:
-		if(__pagetable == 0x0)
+		// Uma página grande já mapeia o endereço inteiro, sem tabela 2:
+		if(__frames[frame_tabela1].words[PTE1OFF(virtaddr)] & PTE_HUGE)
+		{
+			LOG_DEPURACAO("O DADO já está alocado na página grande do FRAME 0x%X\n", PTEFRAME(__frames[frame_tabela1].words[PTE1OFF(virtaddr)]));
+			return;
+		}
+		// Uma tabela 2 compartilhada por os_fork não pode ser alterada por um processo só:
+		if((__frames[frame_tabela1].words[PTE1OFF(virtaddr)] & PTE_COW) && !separar_tabela2(frame_tabela1, PTE1OFF(virtaddr)))
+		{
+			LOG_DEPURACAO("Não houve espaço de MEMÓRIA DE DADOS para separar a TABELA 2 compartilhada\n");
+			return;
+		}
+		// Depois que a tabela 1 é encontrada ou criada, ele procura pela tabela 2 dentro da tabela 1:
+		if(PTEFRAME(__frames[frame_tabela1].words[PTE1OFF(virtaddr)]) == 0x0)
 		{
-			// Procura por um frame livre na memoria de dados para alocar a tabela de página 1:
-			frame_tabela1 = procurar_frame_livre_dados();
+			// A tabela 2 não foi encontrada dentro da tabela 1. Procura por um frame livre na memoria de dados para alocar a tabela de página 2:
+			frame_tabela2 = obter_frame_livre();
+			if(frame_tabela2)
+			{
+				nova_tabela(frame_tabela2);
+				indice_da_tabela2[frame_tabela2] = PTE1OFF(virtaddr);
+				dono_da_tabela2[frame_tabela2] = frame_tabela1;
+				entradas_em_uso[frame_tabela1]++;
+			}
 		}
-		// Existia informações na tabela de sistema para o processo atual:
 		else
 		{
-			frame_tabela1 = PTEFRAME(__frames[linha_livre_ts/256].words[linha_livre_ts%256]);
+			// A tabela 2 foi encontrada dentro da tabela 1:
+			frame_tabela2 = PTEFRAME(__frames[frame_tabela1].words[PTE1OFF(virtaddr)]);
 		}
-		if(frame_tabela1)
+		if(frame_tabela2)
 		{
-			printf("(RETIRAR ESTE PRINT) A TABELA 1 está no FRAME 0x%X da TABELA DE DADOS\n", frame_tabela1);
-			// Se for uma tabela de ágina 1 que estiver entrando agora no mapa de memória, seu frame deve ser atribuido à variável global __pagetable:
-			if(__pagetable == 0x0)
+			LOG_DEPURACAO("A TABELA 2 está no FRAME 0x%X da TABELA DE DADOS\n", frame_tabela2);
+			pte = 0x0;
+			pte = pte | perms | (virtaddr & 0x0000FF00) << 4 | frame_tabela2;
+			LOG_DEPURACAO("Inserindo os DADOS da TABELA 2 na TABELA 1...\n");
+			__frames[frame_tabela1].words[(virtaddr & 0x00FF0000) >> 16] = pte;
+			LOG_DEPURACAO("__frames[0x%X].words[0x%X]: PTE 0x%X\n",frame_tabela1, (virtaddr & 0x00FF0000) >> 16, __frames[frame_tabela1].words[(virtaddr & 0x00FF0000) >> 16]);
+			// Depois que a tabela 2 é encontrada ou criada, ele procura pelo dado dentro da tabela 2:
+			pte = __frames[frame_tabela2].words[PTE2OFF(virtaddr)];
+			if((pte & PTE_VALID) && !(pte & PTE_INMEM))
 			{
-				dccvmm_set_page_table(frame_tabela1);
+				// O dado já foi alocado e está no disco: ele volta para a memória no próximo acesso.
+				LOG_DEPURACAO("O DADO já está alocado no SETOR 0x%X do disco\n", PTESETOR(pte));
+				return;
 			}
-			// configura as permissões para ler e escrever, diz que está em memória e que é valido:
-			uint32_t perms = PTE_RW | PTE_INMEM | PTE_VALID;
-			// Compõe a entrada na tabela de página do sistema operacional: id do processo (8bits) + permissões (4 bits) + 8 bits mais significativos do endereço virtual + frame livre (12 bits) = 8 + 4 + 8 + 12 = 32 bits.
-			pte = pte | (id_processos << 24) | perms | (virtaddr & 0x00FF0000) >> 4 | __pagetable;
-			// Preenche tabela de sistema com os dados da tabela de página 1:
-			printf("(RETIRAR ESTE PRINT) Inserindo os DADOS da TABELA 1 na TABELA DE SISTEMA...\n");
-			__frames[linha_livre_ts/256].words[linha_livre_ts%256] = pte;			
-			printf("(RETIRAR ESTE PRINT) __frames[0x%X].words[0x%X] = 0x%X;\n", linha_livre_ts/256, linha_livre_ts%256, __frames[linha_livre_ts/256].words[linha_livre_ts%256]);
-			// Depois que a tabela 1 é encontrada ou criada, ele procura pela tabela 2 dentro da tabela 1:
-			if(PTEFRAME(__frames[frame_tabela1].words[PTE1OFF(virtaddr)]) == 0x0)
+			if(pte & PTE_COW)
 			{
-				// A tabela 2 não foi encontrada dentro da tabela 1. Procura por um frame livre na memoria de dados para alocar a tabela de página 2:
-				frame_tabela2 = procurar_frame_livre_dados();
+				// O dado já foi alocado e é compartilhado com outro processo: a cópia é feita na primeira escrita.
+				LOG_DEPURACAO("O DADO já está alocado no FRAME compartilhado 0x%X\n", PTEFRAME(pte));
+				return;
+			}
+			if(PTEFRAME(pte) == 0x0 && alocacao_preguicosa)
+			{
+				// O frame só é escolhido no primeiro acesso, por os_pagefault:
+				__frames[frame_tabela2].words[PTE2OFF(virtaddr)] = PTE_RW | PTE_VALID;
+				entradas_em_uso[frame_tabela2]++;
+				return;
+			}
+			if(PTEFRAME(pte) == 0x0)
+			{
+				// O dado não foi encontrado dentro da tabela 2. Procura por um frame livre na memoria de dados para alocar o dado:
+				frame_livre_dado = obter_frame_livre();
+				if(frame_livre_dado) entradas_em_uso[frame_tabela2]++;
 			}
 			else
 			{
-				// A tabela 2 foi encontrada dentro da tabela 1:
-				frame_tabela2 = PTEFRAME(__frames[frame_tabela1].words[PTE1OFF(virtaddr)]);
+				// O dado não foi encontrado dentro da tabela 2:
+				frame_livre_dado = PTEFRAME(__frames[frame_tabela2].words[PTE2OFF(virtaddr)]);
 			}
-			if(frame_tabela2)
+			if(frame_livre_dado)
 			{
-				printf("(RETIRAR ESTE PRINT) A TABELA 2 está no FRAME 0x%X da TABELA DE DADOS\n", frame_tabela2);
-				pte = 0x0;
-				pte = pte | (id_processos << 24) | perms | (virtaddr & 0x0000FF00) << 4 | frame_tabela2;
-				printf("(RETIRAR ESTE PRINT) Inserindo os DADOS da TABELA 2 na TABELA 1...\n");
-				__frames[frame_tabela1].words[(virtaddr & 0x00FF0000) >> 16] = pte;
-				printf("(RETIRAR ESTE PRINT) __frames[0x%X].words[0x%X]: PTE 0x%X\n",frame_tabela1, (virtaddr & 0x00FF0000) >> 16, __frames[frame_tabela1].words[(virtaddr & 0x00FF0000) >> 16]);
-				// Depois que a tabela 2 é encontrada ou criada, ele procura pelo dado dentro da tabela 2:
-				if(PTEFRAME(__frames[frame_tabela2].words[PTE2OFF(virtaddr)]) == 0x0)
-				{
-					// O dado não foi encontrado dentro da tabela 2. Procura por um frame livre na memoria de dados para alocar o dado:
-					frame_livre_dado = procurar_frame_livre_dados();
-				}
-				else
-				{
-					// O dado não foi encontrado dentro da tabela 2:
-					frame_livre_dado = PTEFRAME(__frames[frame_tabela2].words[PTE2OFF(virtaddr)]);
-				}
-				if(frame_livre_dado)
-				{
-					printf("(RETIRAR ESTE PRINT) O DADO foi colocada no FRAME 0x%X da TABELA DE DADOS\n", frame_livre_dado);
-					pte = 0x0;
-					pte = pte | (id_processos << 24) | perms | (virtaddr & 0x0000FF00) << 4 | frame_livre_dado;
-					printf("(RETIRAR ESTE PRINT) Inserindo os DADOS DO FRAME ALOCADO PARA DADOS na TABELA 2...\n");
-					__frames[frame_tabela2].words[(virtaddr & 0x0000FF00) >> 8] = pte;
-					printf("(RETIRAR ESTE PRINT) __frames[0x%X].words[0x%X]: PTE 0x%X\n",frame_tabela2, (virtaddr & 0x0000FF00) >> 8, __frames[frame_tabela2].words[(virtaddr & 0x0000FF00) >> 8]);
-				}
-				else
+				LOG_DEPURACAO("O DADO foi colocada no FRAME 0x%X da TABELA DE DADOS\n", frame_livre_dado);
+				// Se o dado já existia, os bits de referência e de modificação ligados pelo controlador são mantidos:
+				pte = (pte & (PTE_ACCESSED | PTE_DIRTY)) | perms | (virtaddr & 0x0000FF00) << 4 | frame_livre_dado;
+				LOG_DEPURACAO("Inserindo os DADOS DO FRAME ALOCADO PARA DADOS na TABELA 2...\n");
+				__frames[frame_tabela2].words[(virtaddr & 0x0000FF00) >> 8] = pte;
+				if(dono_do_frame[frame_livre_dado].tabela2 == 0x0)
 				{
-					printf("(RETIRAR ESTE PRINT) Não houve espaço de MEMÓRIA DE DADOS para alocar o DADO propriamente dito\n");
-					// Podemos colocar aqui uma condição para o caso de não achar um frame livre e implementar a parte 5
-                    
+					dono_do_frame[frame_livre_dado].tabela2 = frame_tabela2;
+					dono_do_frame[frame_livre_dado].pagina = PAGENUM(virtaddr);
+					politica->carregada(frame_livre_dado);
 				}
+				// A TLB não acompanha alterações na tabela de páginas:
+				dccvmm_tlb_invalidate(__pagetable, virtaddr);
+				LOG_DEPURACAO("__frames[0x%X].words[0x%X]: PTE 0x%X\n",frame_tabela2, (virtaddr & 0x0000FF00) >> 8, __frames[frame_tabela2].words[(virtaddr & 0x0000FF00) >> 8]);
 			}
 			else
 			{
-				printf("(RETIRAR ESTE PRINT) Não houve espaço de MEMÓRIA DE DADOS para alocar a TABELA 2\n");
+				LOG_DEPURACAO("Não houve espaço de MEMÓRIA DE DADOS para alocar o DADO propriamente dito\n");
 				// Podemos colocar aqui uma condição para o caso de não achar um frame livre e implementar a parte 5
+            
 			}
 		}
 		else
 		{
-			printf("(RETIRAR ESTE PRINT) Não houve espaço de MEMÓRIA DE DADOS para alocar a TABELA 1\n");
+			LOG_DEPURACAO("Não houve espaço de MEMÓRIA DE DADOS para alocar a TABELA 2\n");
 			// Podemos colocar aqui uma condição para o caso de não achar um frame livre e implementar a parte 5
 		}
 	}
-	else
+}
+
+void os_alloc(uint32_t virtaddr) {
+	dccvmm_pt_lock();
+	alocar_pagina(virtaddr);
+	dccvmm_pt_unlock();
+}
+
+// Aloca as páginas de primeira a ultima (números de página) do processo atual. A primeira página de cada trecho que cabe numa tabela 2 passa
+// pelo caminho de os_alloc, que encontra ou cria as tabelas 1 e 2; as demais do trecho são preenchidas direto na tabela 2 já resolvida,
+// com os frames reservados no mapa de frames livres de uma vez. Só quando o mapa não tem frames suficientes há despejo, página a página.
+static void alocar_intervalo(uint32_t primeira, uint32_t ultima){
+	uint32_t frames[TAMANHO_FRAME];
+	uint32_t pagina = primeira;
+	while(pagina <= ultima)
 	{
-		printf("(RETIRAR ESTE PRINT) Não houve espaço de MEMÓRIA DE SISTEMA para alocar a TABELA 1\n");
-		// Podemos colocar aqui uma condição para o caso de não achar um frame livre e implementar a parte 5
+		uint32_t fim = (ultima < (pagina | 0xFF)) ? ultima : (pagina | 0xFF);
+		uint32_t k;
+		if(paginas_grandes && (pagina & 0xFF) == 0x0 && fim == (pagina | 0xFF) && mapear_pagina_grande(pagina))
+		{
+			pagina = fim + 1;
+			continue;
+		}
+		alocar_pagina(pagina << 8);
+		uint32_t frame_tabela2 = __pagetable ? PTEFRAME(__frames[__pagetable].words[pagina >> 8]) : 0x0;
+		if(frame_tabela2 == 0x0 || (__frames[__pagetable].words[pagina >> 8] & (PTE_HUGE | PTE_COW)))
+		{
+			// Faltou memória para as tabelas; alocar_pagina já registrou o motivo.
+			return;
+		}
+		uint32_t *tabela2 = __frames[frame_tabela2].words;
+		uint32_t vazias = 0;
+		for(k = (pagina & 0xFF) + 1; k <= (fim & 0xFF); k++)
+		{
+			if(tabela2[k] == 0x0) vazias++;
+		}
+		uint32_t reservados = alocacao_preguicosa ? 0x0 : reservar_frames(frames, vazias);
+		uint32_t usados = 0;
+		ESTAT_ADD(frames_alocados, reservados);
+		ESTAT_ADD(allocs, fim - pagina);
+		for(k = (pagina & 0xFF) + 1; k <= (fim & 0xFF); k++)
+		{
+			// Páginas já alocadas, na memória ou no disco, ficam como estão:
+			if(tabela2[k])
+			{
+				continue;
+			}
+			if(alocacao_preguicosa)
+			{
+				tabela2[k] = PTE_RW | PTE_VALID;
+				entradas_em_uso[frame_tabela2]++;
+				continue;
+			}
+			uint32_t frame = (usados < reservados) ? frames[usados++] : obter_frame_livre();
+			if(frame == 0x0)
+			{
+				LOG_DEPURACAO("Não houve espaço de MEMÓRIA DE DADOS para alocar o DADO da página 0x%X\n", (pagina & 0xFF00) | k);
+				continue;
+			}
+			// Um pte vazio nunca entra na TLB, então não há o que invalidar:
+			tabela2[k] = PTE_RW | PTE_INMEM | PTE_VALID | k << 12 | frame;
+			entradas_em_uso[frame_tabela2]++;
+			dono_do_frame[frame].tabela2 = frame_tabela2;
+			dono_do_frame[frame].pagina = (pagina & 0xFF00) | k;
+			politica->carregada(frame);
+		}
+		pagina = fim + 1;
+	}
+}
+
+// Aloca "paginas" páginas virtuais seguidas do processo atual a partir de inicio:
+void os_alloc_range(uint32_t inicio, uint32_t paginas){
+	// inicio acima do espaço de endereçamento (24 bits) daria a volta em PAGENUM:
+	if(inicio%TAMANHO_FRAME || inicio > 0xFFFFFF || paginas == 0 || PAGENUM(inicio) + paginas > 0x10000)
+	{
+		LOG_ERRO("Erro de segmentação: Não foi possível alocar %u páginas a partir do endereço 0x%X\n", paginas, inicio);
+		return;
 	}
+	dccvmm_pt_lock();
+	alocar_intervalo(PAGENUM(inicio), PAGENUM(inicio) + paginas - 1);
+	dccvmm_pt_unlock();
 }
 
 // Assuminado que o free irá liberar a memória do processo corrente, independende do ID:
-void os_free(uint32_t virtaddr) {
-	printf("\n\n(RETIRAR ESTE PRINT) Entrando na função \"os_free\"\n");
-	uint32_t i;
-	uint32_t j;
+static void liberar_pagina(uint32_t virtaddr) {
+	LOG_DEPURACAO("\n\nEntrando na função \"os_free\"\n");
+	ESTAT_INC(frees);
 	if(virtaddr%TAMANHO_FRAME)
 	{
-		printf("Erro de segmentação: Não foi possível liberar o endereço 0x%X pois ele não é múltiplo do tamanho do frame 0x%X\n", virtaddr, TAMANHO_FRAME);
+		LOG_ERRO("Erro de segmentação: Não foi possível liberar o endereço 0x%X pois ele não é múltiplo do tamanho do frame 0x%X\n", virtaddr, TAMANHO_FRAME);
 		return;
 	}
-	printf("(RETIRAR ESTE PRINT) virtaddr: 0x%X\n", virtaddr);
+	LOG_DEPURACAO("virtaddr: 0x%X\n", virtaddr);
 	// Verifica se a tabela de páginas 1 é um frame válido:
 	if(__pagetable < 0x10)
 	{
-		printf("(RETIRAR ESTE PRINT) O frame que indica a TABELA 1 é inválido. Execução abortada.\n");
+		LOG_DEPURACAO("O frame que indica a TABELA 1 é inválido. Execução abortada.\n");
+		return;
+	}
+	LOG_DEPURACAO("A TABELA 1 (Processo atual) está no FRAME: 0x%X\n", __pagetable);
+	// Uma página grande só pode perder uma página depois de virar uma tabela 2 comum:
+	if((__frames[__pagetable].words[PTE1OFF(virtaddr)] & PTE_HUGE) && !dividir_pagina_grande(__pagetable, PTE1OFF(virtaddr)))
+	{
+		LOG_ERRO("Erro: Não há memória para dividir a página grande do endereço 0x%X\n", virtaddr);
+		return;
+	}
+	if((__frames[__pagetable].words[PTE1OFF(virtaddr)] & PTE_COW) && !separar_tabela2(__pagetable, PTE1OFF(virtaddr)))
+	{
+		LOG_ERRO("Erro: Não há memória para separar a tabela de páginas compartilhada do endereço 0x%X\n", virtaddr);
 		return;
 	}
-	printf("(RETIRAR ESTE PRINT) A TABELA 1 (Processo atual) está no FRAME: 0x%X\n", __pagetable);
 	// Percorre a tabela de páginas 1 procurando pelo frame da tabela 2:
 	// A tabela de páginas 1 do processo atual está guardada na variável global "__pagetable".
 	uint32_t frame_tabela2 = PTEFRAME(__frames[__pagetable].words[PTE1OFF(virtaddr)]);
-	printf("(RETIRAR ESTE PRINT) A TABELA 2 (Processo atual) está no FRAME: 0x%X\n", frame_tabela2);
+	LOG_DEPURACAO("A TABELA 2 (Processo atual) está no FRAME: 0x%X\n", frame_tabela2);
 	if(frame_tabela2 < 0x10)
 	{
-		printf("(RETIRAR ESTE PRINT) O frame que indica a TABELA 2 é inválido. Execução abortada.\n");
+		LOG_DEPURACAO("O frame que indica a TABELA 2 é inválido. Execução abortada.\n");
 		return;
 	}
 	// Percorre a tabela de páginas 2 procurando pelo frame do dado:
 	struct frame *tabela2 = &(__frames[frame_tabela2]);
-	uint32_t frame_dado = PTEFRAME(tabela2->words[PTE2OFF(virtaddr)]);
-	printf("(RETIRAR ESTE PRINT) O FRAME DO DADO (referente ao endereço virtual 0x%X do processo atual) está no FRAME: 0x%X\n", virtaddr, frame_dado);
-
-	// Atualiza a estrutura de frames livres:
-	__frames[0].words[frame_dado/32] &= ~(0x1 << (frame_dado%32)); 
-	printf("(RETIRAR ESTE PRINT) Entrada na tabela de frames livres atualizada: __frames[0].words[%i] = 0x%X\n", frame_dado/32, __frames[0].words[frame_dado/32] );
+	uint32_t pte_dado = tabela2->words[PTE2OFF(virtaddr)];
+	if(pte_dado == 0x0)
+	{
+		// Sem esta verificação o frame 0 (PTEFRAME de um pte vazio) seria dado como livre.
+		LOG_ERRO("Erro de segmentação: O endereço 0x%X não está alocado\n", virtaddr);
+		return;
+	}
+	if((pte_dado & PTE_VALID) && !(pte_dado & PTE_INMEM))
+	{
+		// O dado está no disco: basta liberar o setor.
+		LOG_DEPURACAO("O DADO (referente ao endereço virtual 0x%X do processo atual) está no SETOR: 0x%X\n", virtaddr, PTESETOR(pte_dado));
+	}
+	else
+	{
+		LOG_DEPURACAO("O FRAME DO DADO (referente ao endereço virtual 0x%X do processo atual) está no FRAME: 0x%X\n", virtaddr, PTEFRAME(pte_dado));
+	}
 	// Atualiza a entrada da tabela de páginas 2 referente ao dado que foi liberado:
-	tabela2->words[PTE2OFF(virtaddr)] = 0x0;
+	uint32_t frame_dado = descartar_pagina(frame_tabela2, PTE2OFF(virtaddr));
+	dccvmm_tlb_invalidate(__pagetable, virtaddr);
+	if(frame_dado)
+	{
+		// Atualiza a estrutura de frames livres:
+		liberar_frame_dados(frame_dado);
+	}
 	// Verifica se a tabela de páginas 2 ficou vazia:
-	for(i = 0x0; i<TAMANHO_FRAME; i++)
+	if(--entradas_em_uso[frame_tabela2])
 	{
-		if(tabela2->words[i])
-		{
-			printf("(RETIRAR ESTE PRINT) A TABELA 2 não será apagada pois não ficou vazia depois da liberação do FRAME 0x%X.\n", frame_dado);
-			return;
-		}
+		LOG_DEPURACAO("A TABELA 2 não será apagada pois não ficou vazia depois da liberação do FRAME 0x%X.\n", frame_dado);
+		return;
 	}
-	printf("(RETIRAR ESTE PRINT) A TABELA 2 será apagada pois ficou vazia depois da liberação do FRAME 0x%X.\n", frame_dado);
+	LOG_DEPURACAO("A TABELA 2 será apagada pois ficou vazia depois da liberação do FRAME 0x%X.\n", frame_dado);
 	// Se tabela de páginas 2 ficar vazia, libera a tabela de páginas 2 da memoria de dados:
-	__frames[0].words[frame_tabela2/32] &= ~(0x1 << (frame_tabela2%32));
-	printf("(RETIRAR ESTE PRINT) Entrada na tabela de frames livres atualizada: __frames[0].words[%i] = 0x%X\n", frame_tabela2/32, __frames[0].words[frame_tabela2/32] );
+	liberar_frame_dados(frame_tabela2);
+	ESTAT_DEC(frames_tabelas);
 	// Atualiza a entrada da tabela de páginas 1 referente à tabela de páginas 2 que foi liberada:
 	__frames[__pagetable].words[PTE1OFF(virtaddr)] = 0x0;
+	dccvmm_psc_invalidate(__pagetable, PTE1OFF(virtaddr));
 	// Verifica se a tabela de páginas 1 ficou vazia:
-	for(i = 0x0; i<TAMANHO_FRAME; i++)
+	if(--entradas_em_uso[__pagetable])
+	{
+		LOG_DEPURACAO("A TABELA 1 não será apagada pois não ficou vazia depois da liberação da TABELA 2 que estava no FRAME 0x%X.\n", frame_tabela2);
+		return;
+	}
+	LOG_DEPURACAO("A TABELA 1 será apagada pois ficou vazia depois da liberação da TABELA 2 que estava no FRAME 0x%X.\n", frame_tabela2);
+	liberar_tabela1(id_processos, __pagetable);
+}
+
+void os_free(uint32_t virtaddr) {
+	dccvmm_pt_lock();
+	liberar_pagina(virtaddr);
+	dccvmm_pt_unlock();
+}
+
+// Libera as páginas de [inicio, fim) do processo atual. As tabelas 2 que ficam vazias são liberadas no mesmo passo e, se a tabela 1 ficar vazia,
+// o processo perde a sua linha na tabela de sistema como em os_free. Os frames liberados voltam ao mapa de frames livres em lotes.
+void os_free_range(uint32_t inicio, uint32_t fim){
+	if(inicio%TAMANHO_FRAME || fim%TAMANHO_FRAME || inicio >= fim || fim > 0x1000000)
+	{
+		LOG_ERRO("Erro de segmentação: Intervalo [0x%X, 0x%X) inválido para liberação\n", inicio, fim);
+		return;
+	}
+	dccvmm_pt_lock();
+	uint32_t tabela1 = __pagetable;
+	if(tabela1 >= 0x10)
 	{
-		if(__frames[__pagetable].words[i])
+		struct lote_frames lote;
+		lote.total = 0;
+		desmontar_paginas(tabela1, PAGENUM(inicio), PAGENUM(fim) - 1, &lote);
+		esvaziar_lote(&lote);
+		if(entradas_em_uso[tabela1] == 0)
 		{
-			printf("(RETIRAR ESTE PRINT) A TABELA 1 não será apagada pois não ficou vazia depois da liberação da TABELA 2 que estava no FRAME 0x%X.\n", frame_tabela2);
-			return;
+			liberar_tabela1(id_processos, tabela1);
 		}
 	}
-	printf("(RETIRAR ESTE PRINT) A TABELA 1 será apagada pois ficou vazia depois da liberação da TABELA 2 que estava no FRAME 0x%X.\n", frame_tabela2);
-	// Se tabela de páginas 1 ficar vazia, libera a tabela de páginas 1 da memoria de dados:
-	__frames[0].words[__pagetable/32] &= ~(0x1 << (__pagetable%32));
-	printf("(RETIRAR ESTE PRINT) Entrada na tabela de frames livres atualizada: __frames[0].words[%i] = 0x%X\n", __pagetable/32, __frames[0].words[__pagetable/32]);
-	// Percorre a tabela de sistema para apagar a entrada da tabela de páginas 1, liberando memória para processos futuros:
-	for(i=0x0; i<16; i++)
+	dccvmm_pt_unlock();
+}
+
+// Termina o processo pid: desmonta a árvore de tabelas de páginas dele inteira num passo, sem um os_free por página, e libera a sua linha na tabela de sistema.
+void os_exit(uint32_t pid){
+	if(pid == 0 || pid > MAX_PID)
+	{
+		LOG_ERRO("Erro: o id de processo %u não está entre 1 e %u\n", pid, MAX_PID);
+		return;
+	}
+	dccvmm_pt_lock();
+	uint32_t linha = linha_do_processo[pid];
+	uint32_t tabela1 = linha ? PTEFRAME(PALAVRA_SISTEMA(linha)) : 0x0;
+	if(tabela1)
+	{
+		struct lote_frames lote;
+		lote.total = 0;
+		desmontar_paginas(tabela1, 0x0, 0xFFFF, &lote);
+		esvaziar_lote(&lote);
+		liberar_tabela1(pid, tabela1);
+	}
+	else if(linha)
+	{
+		liberar_linha_sistema(pid);
+	}
+	conjunto[pid].total = 0;
+	dccvmm_pt_unlock();
+}
+
+// A TLB é marcada com a tabela de páginas de cada processo, então a troca de contexto não precisa esvaziá-la.
+void os_swap(uint32_t pid){
+	if(pid == 0 || pid > MAX_PID)
+	{
+		LOG_ERRO("Erro: o id de processo %u não está entre 1 e %u\n", pid, MAX_PID);
+		return;
+	}
+	ESTAT_INC(swaps);
+	dccvmm_pt_lock();
+	if(frames_por_passo && ++trocas_desde_passo >= intervalo_mesclagem)
+	{
+		trocas_desde_passo = 0;
+		passo_mesclagem();
+	}
+	if(!conjunto_trabalho || pid == id_processos)
+	{
+		id_processos = pid;
+		procurar_frame_sistema();
+		dccvmm_pt_unlock();
+		return;
+	}
+	if(__pagetable)
+	{
+		registrar_conjunto(id_processos, __pagetable);
+	}
+	id_processos = pid;
+	procurar_frame_sistema();
+	if(__pagetable)
+	{
+		carregar_conjunto(pid, __pagetable);
+	}
+	dccvmm_pt_unlock();
+}
+
+// Anota o conjunto de trabalho do processo que sai da CPU:
+static void registrar_conjunto(uint32_t pid, uint32_t tabela1){
+	uint32_t i, k, total = 0;
+	for(i = 0; i < TAMANHO_FRAME && total < MAX_CONJUNTO; i++)
 	{
-		(i==0) ? (j=INICIO_TABELA_SISTEMA) : (j=0);
-		for(; j<=FIM_TABELA_SISTEMA ; j++)
+		uint32_t pte1 = __frames[tabela1].words[i];
+		if(PTEFRAME(pte1) == 0x0 || (pte1 & PTE_HUGE))
+		{
+			continue;
+		}
+		uint32_t *tabela2 = __frames[PTEFRAME(pte1)].words;
+		for(k = 0; k < TAMANHO_FRAME && total < MAX_CONJUNTO; k++)
 		{
-			if((__frames[i].words[j] & 0xFFF) == __pagetable)
+			if((tabela2[k] & (PTE_INMEM | PTE_ACCESSED)) == (PTE_INMEM | PTE_ACCESSED) && PTEFRAME(tabela2[k]) != frame_zero)
 			{
-				printf("(RETIRAR ESTE PRINT) A entrada na tabela de sistema __frames[%i].words[%i] = 0x%X referente à TABELA 1 será apagada\n", i, j, __frames[i].words[j]);
-				__frames[i].words[j] = 0x0;
+				conjunto[pid].paginas[total++] = i << 8 | k;
 			}
 		}
 	}
-	// Redefine o apontador global da tabela de páginas 1 do processo atual de modo que não haja acesso inválido enquanto outro processo não alocar memória ou houver um swap:
-	__pagetable = 0x0;
-	return;
+	conjunto[pid].total = total;
 }
 
-void os_swap(uint32_t pid){
-	id_processos = pid;
-	procurar_frame_sistema();
+// Traz do disco, num só pedido por trecho de setores seguidos, as páginas do conjunto de trabalho do processo que volta à CPU e que foram
+// despejadas enquanto ele estava fora:
+static void carregar_conjunto(uint32_t pid, uint32_t tabela1){
+	uint32_t setores[MAX_CONJUNTO], frames[MAX_CONJUNTO], tabelas2[MAX_CONJUNTO], paginas[MAX_CONJUNTO];
+	uint32_t i, n = 0;
+	for(i = 0; i < conjunto[pid].total; i++)
+	{
+		uint32_t pagina = conjunto[pid].paginas[i];
+		uint32_t pte1 = __frames[tabela1].words[pagina >> 8];
+		if(PTEFRAME(pte1) == 0x0 || (pte1 & PTE_HUGE))
+		{
+			continue;
+		}
+		uint32_t *pte = &__frames[PTEFRAME(pte1)].words[pagina & 0xFF];
+		if(!(*pte & PTE_VALID) || (*pte & PTE_INMEM) || PTESETOR(*pte) == 0x0)
+		{
+			continue;
+		}
+		if(anel_compartilhamento[LOCAL(PTEFRAME(pte1), pagina & 0xFF)] && setor_pedido(PTESETOR(*pte), setores, n))
+		{
+			continue;
+		}
+		// Os despejos feitos aqui só tiram páginas residentes; a página do disco continua lá até o pte ser refeito abaixo.
+		frames[n] = obter_frame_livre();
+		if(frames[n] == 0x0)
+		{
+			break;
+		}
+		setores[n] = PTESETOR(*pte);
+		tabelas2[n] = PTEFRAME(pte1);
+		paginas[n++] = pagina;
+	}
+	if(n == 0)
+	{
+		return;
+	}
+	disco_ler(setores, frames, n);
+	for(i = 0; i < n; i++)
+	{
+		mapear_carregada(LOCAL(tabelas2[i], paginas[i] & 0xFF), paginas[i], frames[i], setores[i]);
+	}
+	ESTAT_ADD(paginas_na_troca, n);
 }
 
-// Procura por uum frame livre na memória de dados:
-uint32_t procurar_frame_livre_dados(void){
-	uint32_t i;
-	uint32_t j;
-	uint32_t mascara;
+// Reserva até "quantos" frames livres no mapa e os coloca em "frames"; retorna a quantidade reservada.
+// A busca começa na palavra do mapa onde a última reserva parou (next-fit), pula as palavras cheias e tira da palavra os bits zerados
+// menos significativos. Não há trava: cada palavra é reservada com compare-and-swap e refeita se outra thread alterou a palavra antes.
+static uint32_t reservar_frames(uint32_t *frames, uint32_t quantos){
+	uint32_t n;
+	uint32_t reservados = 0;
+	uint32_t i = __atomic_load_n(&cursor_frames_livres, __ATOMIC_RELAXED);
 	// Como a estrutura de frames livres ocupa apenas meio frame, teremos que procurar dentro do frame 0 da memória de sistema.
 	// Dentro do frame 0, procuramos em uma das 128 primeiras linhas:
-	printf("(RETIRAR ESTE PRINT) Procurando por um FRAME LIVRE na TABELA DE DADOS...\n");
-	for(i = INICIO_FRAMES_LIVRES; i<=FIM_FRAMES_LIVRES; i++)
+	for(n = INICIO_FRAMES_LIVRES; n <= FIM_FRAMES_LIVRES && reservados < quantos; n++)
 	{
-		// Dentro do frame 0, linha i, procura o bit referente àquele frame. Os bits variam de 0 a 31:
-		for(j=0x0; j<32; j++)
+		if(__atomic_load_n(&total_frames_livres, __ATOMIC_RELAXED) == 0)
+		{
+			break;
+		}
+		uint32_t *palavra = &__frames[0].words[i];
+		uint32_t atual = __atomic_load_n(palavra, __ATOMIC_RELAXED);
+		while(atual != 0xFFFFFFFF)
 		{
-			// Faz uma máscara relativa àquele frame em questão para ver se ele está livre ou não:
-			mascara = 0x1 << j;
-			if((__frames[0].words[i] & mascara) == 0)
+			uint32_t livres = ~atual;
+			uint32_t bits = 0;
+			uint32_t k;
+			for(k = reservados; livres && k < quantos; k++)
 			{
-				// Se o frame estiver livre, ele deve ser dado como ocupado:
-				__frames[0].words[i] |= mascara;
-				// E o frame que foi encontrado é atribuido à variável de frame_livre:
-				printf("(RETIRAR ESTE PRINT) O FRAME 0x%X da TABELA DE DADOS está DISPONÍVEL\n", (32*i)+j);
-				return (32*i)+j;
+				bits |= livres & -livres;
+				livres &= livres - 1;
+			}
+			// Os frames devem ser dados como ocupados:
+			if(__atomic_compare_exchange_n(palavra, &atual, atual | bits, 1, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			{
+				__atomic_sub_fetch(&total_frames_livres, k - reservados, __ATOMIC_RELAXED);
+				__atomic_store_n(&cursor_frames_livres, i, __ATOMIC_RELAXED);
+				for(; bits; bits &= bits - 1)
+				{
+					frames[reservados++] = (32*i) + __builtin_ctz(bits);
+				}
+				break;
 			}
 		}
+		i = (i == FIM_FRAMES_LIVRES) ? INICIO_FRAMES_LIVRES : i + 1;
 	}
-	return 0x0;
+	return reservados;
 }
 
-uint32_t procurar_frame_sistema(void){
-	uint32_t i;
-	uint32_t j;
-	printf("(RETIRAR ESTE PRINT) Procurando pela linha da TABELA DE SISTEMA que contém as INFORMAÇÕES DA TABELA 1 DO PROCESSO %i...\n", id_processos);
-	for(i=0x0; i<16; i++)
+// Devolve frames ao mapa de frames livres; retorna quantos estavam de fato ocupados.
+// Frames seguidos que caem na mesma palavra do mapa são devolvidos com uma única operação atômica:
+static uint32_t devolver_frames(const uint32_t *frames, uint32_t quantos){
+	uint32_t i = 0;
+	uint32_t devolvidos = 0;
+	while(i < quantos)
 	{
-		(i==0) ? (j=INICIO_TABELA_SISTEMA) : (j=0);
-		for(; j<=FIM_TABELA_SISTEMA ; j++)
+		uint32_t palavra = frames[i]/32;
+		uint32_t mascara = 0x0;
+		for(; i < quantos && frames[i]/32 == palavra; i++)
 		{
-			if((__frames[i].words[j] & id_processos << 24) == id_processos << 24)
-			{
-				printf("(RETIRAR ESTE PRINT) OS DADOS DA TABELA 1 foram encontrados na linha %i DA TABELA DE SISTEMA\n", (i*256) + j);
-							// Seta variável global com o frame da tabela de pagina 1 do processo atual:
-				dccvmm_set_page_table(PTEFRAME(__frames[i].words[j]));
-				return (i*256) + j;
-			}
+			mascara |= 0x1u << (frames[i]%32);
 		}
+		devolvidos += __builtin_popcount(__atomic_fetch_and(&__frames[0].words[palavra], ~mascara, __ATOMIC_RELEASE) & mascara);
 	}
-	printf("(RETIRAR ESTE PRINT) NÃO foram encontradas as informações da TABELA 1 do PROCESSO %i NA TABELA DE SISTEMA.\n", id_processos);
-	printf("(RETIRAR ESTE PRINT) Procurando por uma linha livre na TABELA DE SISTEMA para alocar A TABELA 1 DO PROCESSO %i...\n", id_processos);
-	for(i=0x0; i<16; i++)
+	__atomic_add_fetch(&total_frames_livres, devolvidos, __ATOMIC_RELAXED);
+	return devolvidos;
+}
+
+// Reserva um bloco de HUGE_FRAMES frames seguidos, alinhado, para uma página grande: são 8 palavras inteiras do mapa de frames livres.
+// O bloco 0 tem os frames do sistema e nunca está livre. Retorna o primeiro frame do bloco ou 0 se a memória estiver fragmentada demais.
+static uint32_t reservar_bloco(void){
+	uint32_t bloco, p;
+	for(bloco = 1; bloco < NUMFRAMES / HUGE_FRAMES; bloco++)
 	{
-		(i==0) ? (j=INICIO_TABELA_SISTEMA) : (j=0);
-		for(; j<=FIM_TABELA_SISTEMA ; j++)
+		uint32_t *palavras = &__frames[0].words[bloco * (HUGE_FRAMES / 32)];
+		for(p = 0; p < HUGE_FRAMES / 32 && __atomic_load_n(&palavras[p], __ATOMIC_RELAXED) == 0x0; p++);
+		if(p < HUGE_FRAMES / 32)
+		{
+			continue;
+		}
+		for(p = 0; p < HUGE_FRAMES / 32; p++)
 		{
-			if(__frames[i].words[j] == 0x0)
+			uint32_t livre = 0x0;
+			if(!__atomic_compare_exchange_n(&palavras[p], &livre, 0xFFFFFFFF, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
 			{
-				printf("(RETIRAR ESTE PRINT) OS DADOS DA TABELA 1 DO PROCESSO %i serão inseridos na linha 0X%X DA TABELA DE SISTEMA\n", id_processos, (i*256) + j);
-				__frames[i].words[j] = (id_processos << 24);
-				dccvmm_set_page_table(0x0);
-				return (i*256) + j;
+				break;
 			}
 		}
+		if(p == HUGE_FRAMES / 32)
+		{
+			__atomic_sub_fetch(&total_frames_livres, HUGE_FRAMES, __ATOMIC_RELAXED);
+			ESTAT_ADD(frames_alocados, HUGE_FRAMES);
+			return bloco * HUGE_FRAMES;
+		}
+		// Outra thread pegou um frame do bloco no meio da reserva: as palavras já tomadas são devolvidas.
+		while(p--)
+		{
+			__atomic_store_n(&palavras[p], 0x0, __ATOMIC_RELEASE);
+		}
 	}
-	dccvmm_set_page_table(0x0);
 	return 0x0;
 }
 
-uint32_t dump_setor_livre (uint32_t frame) {
-    int i, j, k;
-
-    for (i = 0; i < 0x80; i++) {
-        dccvmm_load_frame(i, 0x1);
-        for (j = 0; j < 0x100; j++) {
-            for (k = 0; k < 0x20; k++) {
-                if (!(__frames[i].words[j] & (0x00000001 << k))) { // Setor livre
-                    dccvmm_dump_frame(frame, k + (j * 0x20) + (i * 0x20 * 0x100));
-                    return k + (j * 0x20) + (i * 0x20 * 0x100);
-                }
-            }
-        }
-    }
-    printf("Erro: Acabou o espaço em disco.\n");
-    return VM_ABORT;
+static void devolver_bloco(uint32_t base){
+	uint32_t p;
+	for(p = 0; p < HUGE_FRAMES / 32; p++)
+	{
+		__atomic_store_n(&__frames[0].words[base / 32 + p], 0x0, __ATOMIC_RELEASE);
+	}
+	__atomic_add_fetch(&total_frames_livres, HUGE_FRAMES, __ATOMIC_RELAXED);
+	ESTAT_ADD(frames_liberados, HUGE_FRAMES);
 }
 
-void restaurar_setor (uint32_t setor, uint32_t frame) {
-    dccvmm_load_frame(setor, frame);
-
-    uint32_t i, j, k;
-    i = setor / (0x20 * 0x100); // Frame
-    j = (setor % (0x20 * 0x100)) / 0x20 // Word offset
-    k = setor % 0x20; // Bit offset
-
-    uint32_t mask = ~(0x00000001 << k);
+// Mapeia as 256 páginas da entrada da tabela 1 que começa em "pagina" numa página grande. Retorna 0, sem mapear nada, se a entrada já estiver
+// em uso ou se não houver um bloco de frames livres alinhado; o chamador aloca então as páginas uma a uma.
+static int mapear_pagina_grande(uint32_t pagina){
+	uint32_t tabela1 = obter_tabela1(pagina << 8);
+	if(tabela1 == 0x0 || __frames[tabela1].words[pagina >> 8])
+	{
+		return 0;
+	}
+	uint32_t base = reservar_bloco();
+	if(base == 0x0)
+	{
+		LOG_DEPURACAO("Não há bloco de frames livres para a página grande 0x%X; as páginas serão alocadas uma a uma\n", pagina);
+		return 0;
+	}
+	LOG_DEPURACAO("Página grande 0x%X mapeada nos FRAMES 0x%X a 0x%X\n", pagina, base, base + HUGE_FRAMES - 1);
+	__frames[tabela1].words[pagina >> 8] = PTE_HUGE | PTE_RW | PTE_INMEM | PTE_VALID | base;
+	entradas_em_uso[tabela1]++;
+	ESTAT_ADD(allocs, HUGE_FRAMES);
+	ESTAT_INC(paginas_grandes);
+	return 1;
+}
 
-    dccvmm_load_frame(i, 0x1); // Pull usage frame
+// Troca a página grande da entrada "indice" da tabela 1 por uma tabela 2 com 256 páginas comuns nos mesmos frames, que passam a poder ser
+// despejadas e liberadas uma a uma. As traduções na TLB continuam certas. Retorna 0 se não houver frame para a tabela 2.
+static int dividir_pagina_grande(uint32_t tabela1, uint32_t indice){
+	uint32_t pte1 = __frames[tabela1].words[indice];
+	uint32_t base = PTEFRAME(pte1);
+	uint32_t frame_tabela2 = obter_frame_livre();
+	uint32_t k;
+	if(frame_tabela2 == 0x0)
+	{
+		return 0;
+	}
+	nova_tabela(frame_tabela2);
+	dono_da_tabela2[frame_tabela2] = tabela1;
+	indice_da_tabela2[frame_tabela2] = indice;
+	for(k = 0; k < HUGE_FRAMES; k++)
+	{
+		__frames[frame_tabela2].words[k] = (pte1 & (PTE_ACCESSED | PTE_DIRTY | PTE_RW | PTE_INMEM | PTE_VALID)) | k << 12 | (base + k);
+		dono_do_frame[base + k].tabela2 = frame_tabela2;
+		dono_do_frame[base + k].pagina = indice << 8 | k;
+		politica->carregada(base + k);
+	}
+	entradas_em_uso[frame_tabela2] = HUGE_FRAMES;
+	__frames[tabela1].words[indice] = (pte1 & ~(PTE_HUGE | 0xFFF)) | frame_tabela2;
+	ESTAT_INC(paginas_grandes_divididas);
+	return 1;
+}
 
-    __frames[1].words[j] &= mask; // Set unused
+// Dá à entrada "indice" da tabela 1 uma tabela 2 só dela. Se outra tabela 1 ainda usa a tabela 2, ela é copiada e cada página das duas,
+// na memória ou no disco, passa a ser compartilhada somente para leitura: o pte da cópia entra no anel do pte da tabela antiga, sem trazer
+// nada do disco. Se a entrada era a última a usar a tabela 2, basta devolver a permissão de escrita. Retorna 0 se não houver frame para
+// a cópia, sem alterar a entrada.
+static int separar_tabela2(uint32_t tabela1, uint32_t indice){
+	uint32_t pte1 = __frames[tabela1].words[indice];
+	uint32_t antiga = PTEFRAME(pte1);
+	uint32_t k;
+	if(referencias[antiga] == 0x0)
+	{
+		dono_da_tabela2[antiga] = tabela1;
+		__frames[tabela1].words[indice] = (pte1 & ~PTE_COW) | PTE_RW;
+		dccvmm_psc_invalidate(tabela1, indice);
+		return 1;
+	}
+	uint32_t nova = obter_frame_livre();
+	if(nova == 0x0)
+	{
+		return 0;
+	}
+	nova_tabela(nova);
+	indice_da_tabela2[nova] = indice;
+	for(k = 0; k < TAMANHO_FRAME; k++)
+	{
+		uint32_t pte = __frames[antiga].words[k];
+		if(pte == 0x0)
+		{
+			continue;
+		}
+		uint32_t frame = PTEFRAME(pte);
+		if(((pte & PTE_VALID) && !(pte & PTE_INMEM) && PTESETOR(pte) == 0x0) || (frame == frame_zero && (pte & PTE_INMEM)))
+		{
+			// Página nunca escrita: não tem frame próprio nem setor, e as duas tabelas a tratam de forma independente.
+			__frames[nova].words[k] = pte;
+			continue;
+		}
+		// O frame continua com o dono que tinha na tabela antiga; uma página no disco fica no mesmo setor.
+		entrar_no_anel(LOCAL(antiga, k), LOCAL(nova, k));
+		if(pte & PTE_INMEM)
+		{
+			referencias[PTEFRAME(pte)]++;
+		}
+		// As duas tabelas ficam com o mesmo pte, sem permissão de escrita. Só traduções de leitura desta página podem estar na TLB.
+		pte = (pte & ~PTE_RW) | PTE_COW;
+		__frames[antiga].words[k] = pte;
+		__frames[nova].words[k] = pte;
+	}
+	entradas_em_uso[nova] = entradas_em_uso[antiga];
+	referencias[antiga]--;
+	dono_da_tabela2[nova] = tabela1;
+	__frames[tabela1].words[indice] = (pte1 & ~(PTE_COW | 0xFFF)) | PTE_RW | nova;
+	dccvmm_psc_invalidate(tabela1, indice);
+	ESTAT_INC(tabelas_separadas);
+	return 1;
+}
 
-    dccvmm_dump_frame(0x1, i); // Push updated usage
-}
\ No newline at end of file
+// Dá ao processo atual uma cópia própria da página compartilhada do endereço, que já está numa tabela 2 só dele. Se nenhum outro processo usa
+// mais o frame, ele volta a ser do processo sem cópia. Retorna 0 se faltar memória.
+static int copiar_pagina(uint32_t address){
+	uint32_t frame_tabela2 = PTEFRAME(__frames[__pagetable].words[PTE1OFF(address)]);
+	uint32_t local = LOCAL(frame_tabela2, PTE2OFF(address));
+	uint32_t *pte = PTE_DO_LOCAL(local);
+	uint32_t frame = PTEFRAME(*pte);
+	if(frame == frame_zero || referencias[frame])
+	{
+		uint32_t copia = obter_frame_livre();
+		if(copia == 0x0)
+		{
+			LOG_ERRO("Erro: Não há frame livre para copiar a página compartilhada do endereço virtual 0x%X\n", address);
+			return 0;
+		}
+		if(!(*pte & PTE_INMEM))
+		{
+			// O despejo que liberou o frame da cópia levou a página compartilhada para o disco: a cópia é lida do setor, que continua com
+			// os outros ptes do anel.
+			uint32_t setor = PTESETOR(*pte);
+			disco_ler(&setor, &copia, 1);
+			sair_do_anel(local);
+			*pte = (*pte & 0xFFF00000) | PTE_INMEM | PTE2OFF(address) << 12;
+			ESTAT_INC(paginas_carregadas);
+			ESTAT_INC(copias_na_escrita);
+		}
+		else if(frame == frame_zero)
+		{
+			// O frame zero não conta referências: a cópia é só um frame zerado.
+			dccvmm_zero(copia);
+			ESTAT_INC(paginas_zeradas);
+		}
+		else
+		{
+			memcpy(__frames[copia].words, __frames[frame].words, sizeof(__frames[copia].words));
+			deixar_frame_compartilhado(frame, local);
+			ESTAT_INC(copias_na_escrita);
+		}
+		dono_do_frame[copia].tabela2 = frame_tabela2;
+		dono_do_frame[copia].pagina = PAGENUM(address);
+		politica->carregada(copia);
+		frame = copia;
+	}
+	// Sem cópia, o pte já é o dono do frame, que continua na política de substituição.
+	mesclado[frame] = 0;
+	*pte = (*pte & ~(PTE_COW | 0xFFF)) | PTE_RW | frame;
+	// A tradução de leitura que estiver na TLB aponta para o frame compartilhado:
+	dccvmm_tlb_invalidate(__pagetable, address);
+	return 1;
+}
+
+// Primeiro acesso a uma página alocada sem frame. Uma leitura mapeia a página no frame zero, sem PTE_RW e com PTE_COW, para que a primeira
+// escrita passe por copiar_pagina; uma escrita recebe logo um frame zerado. Retorna 0 se faltar memória.
+static int tocar_pagina(uint32_t address, uint32_t perms){
+	uint32_t frame_tabela2 = PTEFRAME(__frames[__pagetable].words[PTE1OFF(address)]);
+	uint32_t *pte = &__frames[frame_tabela2].words[PTE2OFF(address)];
+	if(!(perms & PTE_RW))
+	{
+		*pte = PTE_VALID | PTE_INMEM | PTE_COW | (address & 0x0000FF00) << 4 | frame_zero;
+		ESTAT_INC(leituras_pagina_zero);
+		return 1;
+	}
+	uint32_t frame = obter_frame_livre();
+	if(frame == 0x0)
+	{
+		LOG_ERRO("Erro: Não há frame livre para a página do endereço virtual 0x%X\n", address);
+		return 0;
+	}
+	dccvmm_zero(frame);
+	*pte = PTE_RW | PTE_VALID | PTE_INMEM | (address & 0x0000FF00) << 4 | frame;
+	dono_do_frame[frame].tabela2 = frame_tabela2;
+	dono_do_frame[frame].pagina = PAGENUM(address);
+	politica->carregada(frame);
+	ESTAT_INC(paginas_zeradas);
+	return 1;
+}
+
+// Pte da página que está no frame, se ela pode ser mesclada: residente, com um frame só dela e numa tabela 2 que não é compartilhada.
+static uint32_t *pagina_mesclavel(uint32_t frame){
+	uint32_t tabela2 = dono_do_frame[frame].tabela2;
+	if(tabela2 == 0x0 || dono_da_tabela2[tabela2] == 0x0 || frame == frame_zero || referencias[frame])
+	{
+		return NULL;
+	}
+	uint32_t *pte = pte_do_frame(frame);
+	return ((*pte & PTE_INMEM) && PTEFRAME(*pte) == frame) ? pte : NULL;
+}
+
+static uint32_t somar_frame(uint32_t frame){
+	uint32_t soma = 0x811C9DC5, k;
+	for(k = 0; k < TAMANHO_FRAME; k++)
+	{
+		soma = (soma ^ __frames[frame].words[k]) * 0x01000193;
+	}
+	return soma;
+}
+
+// Tira a página privada do frame que vai ser liberado (o pte já foi alterado pelo chamador): o frame sai da política de substituição e
+// o setor com a cópia da página é liberado.
+static void largar_frame(uint32_t frame, uint32_t pte){
+	conferir_antecipada(frame, pte);
+	dono_do_frame[frame].tabela2 = 0x0;
+	politica->liberada(frame);
+	if(setor_do_frame[frame])
+	{
+		liberar_setor(setor_do_frame[frame]);
+		setor_do_frame[frame] = 0x0;
+	}
+}
+
+// Passa a página do pte para o frame "alvo", somente para leitura e no anel das páginas do alvo, e libera o frame em que ela estava.
+// O pte perde PTE_DIRTY: o conteúdo passa a ser o do alvo, que tem a sua própria cópia no disco.
+static void mesclar_pagina(uint32_t frame, uint32_t *pte, uint32_t alvo){
+	uint32_t local = local_do_dono(frame);
+	invalidar_frame(frame);
+	*pte = (*pte & ~(PTE_RW | PTE_DIRTY | 0xFFF)) | PTE_COW | alvo;
+	if(alvo != frame_zero)
+	{
+		entrar_no_anel(local_do_dono(alvo), local);
+		referencias[alvo]++;
+		ESTAT_INC(paginas_mescladas);
+	}
+	else
+	{
+		ESTAT_INC(mescladas_no_zero);
+	}
+	largar_frame(frame, *pte);
+	liberar_frame_dados(frame);
+}
+
+// Um passo da mesclagem de páginas iguais; chamada com a trava das tabelas de páginas:
+static void passo_mesclagem(void){
+	static const struct frame zeros;
+	uint32_t n, *pte;
+	ESTAT_INC(passos_mesclagem);
+	for(n = 0; n < frames_por_passo; n++)
+	{
+		uint32_t frame = cursor_mesclagem;
+		cursor_mesclagem = (cursor_mesclagem + 1) % NUMFRAMES;
+		if((pte = pagina_mesclavel(frame)) == NULL)
+		{
+			continue;
+		}
+		ESTAT_INC(paginas_examinadas);
+		uint32_t soma = somar_frame(frame);
+		// Páginas que mudaram desde o passo anterior provavelmente vão mudar de novo; elas esperam o próximo passo:
+		if(soma != soma_do_frame[frame])
+		{
+			soma_do_frame[frame] = soma;
+			continue;
+		}
+		if(frame_zero && !memcmp(&__frames[frame], &zeros, sizeof(zeros)))
+		{
+			mesclar_pagina(frame, pte, frame_zero);
+			continue;
+		}
+		uint16_t *posicao = &indice_mesclagem[soma % TAMANHO_INDICE_MESCLAGEM];
+		uint32_t alvo = *posicao;
+		uint32_t *pte_alvo = NULL;
+		if(alvo == frame || alvo == 0x0 || memcmp(&__frames[alvo], &__frames[frame], sizeof(struct frame))
+				|| (!(mesclado[alvo] && referencias[alvo]) && (pte_alvo = pagina_mesclavel(alvo)) == NULL))
+		{
+			*posicao = (uint16_t) frame;
+			continue;
+		}
+		if(pte_alvo)
+		{
+			// O alvo ainda é uma página privada: passa a ser compartilhado, sem escrita.
+			invalidar_frame(alvo);
+			*pte_alvo = (*pte_alvo & ~PTE_RW) | PTE_COW;
+			mesclado[alvo] = 1;
+		}
+		mesclar_pagina(frame, pte, alvo);
+	}
+}
+
+void os_mesclagem(uint32_t frames, uint32_t intervalo){
+	frames_por_passo = frames;
+	intervalo_mesclagem = intervalo ? intervalo : 1;
+}
+
+// Cria o processo filho com o mesmo espaço de endereçamento do pai. O filho ganha só uma tabela 1, cujas entradas apontam para as tabelas 2
+// do pai; as entradas das duas tabelas 1 perdem PTE_RW e a cópia de tabelas e páginas é feita nas escritas, por os_pagefault.
+// As páginas grandes do pai são divididas antes. O filho não pode ter memória alocada.
+void os_fork(uint32_t pai, uint32_t filho){
+	uint32_t i;
+	if(pai == 0 || pai > MAX_PID || filho == 0 || filho > MAX_PID || pai == filho)
+	{
+		LOG_ERRO("Erro: fork inválido do processo %u para o processo %u\n", pai, filho);
+		return;
+	}
+	dccvmm_pt_lock();
+	uint32_t linha_pai = linha_do_processo[pai];
+	uint32_t linha_filho = linha_do_processo[filho];
+	uint32_t tabela_pai = linha_pai ? PTEFRAME(PALAVRA_SISTEMA(linha_pai)) : 0x0;
+	uint32_t tabela_filho = linha_filho ? PTEFRAME(PALAVRA_SISTEMA(linha_filho)) : 0x0;
+	if(tabela_pai == 0x0 || tabela_filho)
+	{
+		LOG_ERRO("Erro: o processo %u não tem memória alocada ou o processo %u já existe\n", pai, filho);
+		dccvmm_pt_unlock();
+		return;
+	}
+	for(i = 0; i < TAMANHO_FRAME; i++)
+	{
+		if((__frames[tabela_pai].words[i] & PTE_HUGE) && !dividir_pagina_grande(tabela_pai, i))
+		{
+			break;
+		}
+	}
+	tabela_filho = (i == TAMANHO_FRAME) ? obter_frame_livre() : 0x0;
+	if(tabela_filho == 0x0)
+	{
+		LOG_ERRO("Erro: Não há memória para criar o processo %u\n", filho);
+		dccvmm_pt_unlock();
+		return;
+	}
+	// A linha do filho só é reservada depois que nada mais pode falhar, para não ficar presa a um processo que não foi criado:
+	if(linha_filho == 0x0 && total_linhas_livres)
+	{
+		linha_filho = linhas_livres[--total_linhas_livres];
+		PALAVRA_SISTEMA(linha_filho) = (filho << 24);
+		linha_do_processo[filho] = linha_filho;
+	}
+	if(linha_filho == 0x0)
+	{
+		LOG_ERRO("Erro: Não há linha livre na tabela de sistema para o processo %u\n", filho);
+		liberar_frame_dados(tabela_filho);
+		dccvmm_pt_unlock();
+		return;
+	}
+	nova_tabela(tabela_filho);
+	for(i = 0; i < TAMANHO_FRAME; i++)
+	{
+		uint32_t pte1 = __frames[tabela_pai].words[i];
+		if(pte1 == 0x0)
+		{
+			continue;
+		}
+		referencias[PTEFRAME(pte1)]++;
+		dono_da_tabela2[PTEFRAME(pte1)] = 0x0;
+		pte1 = (pte1 & ~PTE_RW) | PTE_COW;
+		__frames[tabela_pai].words[i] = pte1;
+		__frames[tabela_filho].words[i] = pte1;
+	}
+	entradas_em_uso[tabela_filho] = entradas_em_uso[tabela_pai];
+	// As traduções do pai na TLB ainda permitem escrita:
+	dccvmm_tlb_flush(tabela_pai);
+	PALAVRA_SISTEMA(linha_filho) = (filho << 24) | PTE_RW | PTE_INMEM | PTE_VALID | tabela_filho;
+	if(filho == id_processos)
+	{
+		dccvmm_set_page_table(tabela_filho);
+	}
+	// O filho começa com o conjunto de trabalho do pai, cujas páginas ele compartilha:
+	conjunto[filho] = conjunto[pai];
+	ESTAT_INC(forks);
+	dccvmm_pt_unlock();
+}
+
+// Procura por um frame livre na memória de dados. Com cache, o frame sai do cache da thread, que é reabastecido do mapa em lotes:
+uint32_t procurar_frame_livre_dados(void){
+	uint32_t frame = 0x0;
+	if(!cache_frames.ativo)
+	{
+		reservar_frames(&frame, 1);
+	}
+	else
+	{
+		if(cache_frames.total == 0)
+		{
+			cache_frames.total = reservar_frames(cache_frames.frames, LOTE_FRAMES);
+		}
+		if(cache_frames.total)
+		{
+			frame = cache_frames.frames[--cache_frames.total];
+		}
+	}
+	if(frame)
+	{
+		ESTAT_INC(frames_alocados);
+	}
+	return frame;
+}
+
+// Procura por um frame livre na memória de dados. Se a memória estiver cheia, despeja uma página para o disco e usa o frame dela:
+uint32_t obter_frame_livre(void){
+	uint32_t frame = procurar_frame_livre_dados();
+	if(frame == 0x0)
+	{
+		frame = despejar_pagina();
+	}
+	return frame;
+}
+
+// Escolhe um frame de dados, grava seu conteúdo num setor livre do disco e marca a página como fora da memória; os ptes de uma página
+// compartilhada passam todos para o mesmo setor. O frame continua ocupado no mapa de frames livres e é devolvido para quem precisava dele;
+// retorna 0 se não for possível despejar.
+uint32_t despejar_pagina(void){
+	uint32_t frame = politica->escolher_vitima();
+	if(frame == 0x0)
+	{
+		return 0x0;
+	}
+	uint32_t inicio = local_do_dono(frame), local;
+	uint32_t setor = setor_do_frame[frame];
+	// A TLB sai antes da leitura de PTE_DIRTY: nenhuma escrita pode ser feita no frame depois dessa decisão.
+	invalidar_frame(frame);
+	uint32_t *pte = pte_do_frame(frame);
+	conferir_antecipada(frame, *pte);
+	if(setor && !(*pte & PTE_DIRTY))
+	{
+		// Página limpa com cópia no disco: não há o que gravar.
+		ESTAT_INC(escritas_evitadas);
+	}
+	else if(setor)
+	{
+		disco_gravar(frame, setor);
+		ESTAT_INC(escritas_paginas);
+	}
+	else
+	{
+		setor = dump_setor_livre(frame);
+		if(setor == VM_ABORT)
+		{
+			return 0x0;
+		}
+		ESTAT_INC(escritas_paginas);
+	}
+	for(local = inicio; local; local = seguinte_no_anel(local, inicio))
+	{
+		pte = PTE_DO_LOCAL(local);
+		*pte = (*pte & 0xFFF00000 & ~(PTE_INMEM | PTE_DIRTY | PTE_ACCESSED)) | setor;
+	}
+	referencias[frame] = 0;
+	mesclado[frame] = 0;
+	setor_do_frame[frame] = 0x0;
+	dono_do_frame[frame].tabela2 = 0x0;
+	politica->liberada(frame);
+	ESTAT_INC(despejos);
+	return frame;
+}
+
+// Libera a página do pte "indice" da tabela 2, esteja ela no disco ou na memória, e zera o pte. Retorna o frame de dados que ficou sem dono,
+// que o chamador devolve ao mapa de frames livres depois de invalidar a TLB (0 se a página estava no disco ou continua com outros ptes):
+static uint32_t descartar_pagina(uint32_t frame_tabela2, uint32_t indice){
+	uint32_t *pte = &__frames[frame_tabela2].words[indice];
+	uint32_t frame = 0x0;
+	if((*pte & PTE_VALID) && !(*pte & PTE_INMEM))
+	{
+		// Setor 0: página alocada que nunca foi usada. O setor de uma página compartilhada fica com os outros ptes do anel.
+		if(PTESETOR(*pte) && sair_do_anel(LOCAL(frame_tabela2, indice)) == 0x0)
+		{
+			liberar_setor(PTESETOR(*pte));
+		}
+	}
+	else
+	{
+		frame = PTEFRAME(*pte);
+		if(frame == frame_zero)
+		{
+			*pte = 0x0;
+			return 0x0;
+		}
+		if(referencias[frame])
+		{
+			// Outro pte ainda usa o frame compartilhado:
+			deixar_frame_compartilhado(frame, LOCAL(frame_tabela2, indice));
+			*pte = 0x0;
+			return 0x0;
+		}
+		mesclado[frame] = 0;
+		if(setor_do_frame[frame])
+		{
+			liberar_setor(setor_do_frame[frame]);
+			setor_do_frame[frame] = 0x0;
+		}
+		if(dono_do_frame[frame].tabela2)
+		{
+			conferir_antecipada(frame, *pte);
+			dono_do_frame[frame].tabela2 = 0x0;
+			politica->liberada(frame);
+		}
+	}
+	*pte = 0x0;
+	return frame;
+}
+
+static void esvaziar_lote(struct lote_frames *lote){
+	liberar_frames_dados(lote->frames, lote->total);
+	lote->total = 0;
+}
+
+static void acrescentar_lote(struct lote_frames *lote, uint32_t frame){
+	if(lote->total == TAMANHO_FRAME)
+	{
+		esvaziar_lote(lote);
+	}
+	lote->frames[lote->total++] = frame;
+}
+
+// Libera as páginas de primeira a ultima (números de página) da tabela 1 e as tabelas 2 que ficarem vazias, colocando os frames no lote.
+// Os contadores de entradas em uso limitam a varredura às entradas ocupadas. Com mais de uma tabela 2 envolvida, a TLB da tabela 1 inteira é
+// esvaziada de uma vez em vez de uma invalidação por página.
+static void desmontar_paginas(uint32_t tabela1, uint32_t primeira, uint32_t ultima, struct lote_frames *lote){
+	uint32_t i, j;
+	int por_pagina = (primeira >> 8) == (ultima >> 8);
+	if(!por_pagina)
+	{
+		dccvmm_tlb_flush(tabela1);
+	}
+	for(i = primeira >> 8; i <= (ultima >> 8) && entradas_em_uso[tabela1]; i++)
+	{
+		uint32_t pte1 = __frames[tabela1].words[i];
+		if((pte1 & PTE_HUGE) && primeira <= (i << 8) && ultima >= (i << 8 | 0xFF))
+		{
+			// A página grande inteira sai: o bloco volta para o mapa de uma vez.
+			if(por_pagina)
+			{
+				dccvmm_tlb_flush(tabela1);
+			}
+			devolver_bloco(PTEFRAME(pte1));
+			__frames[tabela1].words[i] = 0x0;
+			entradas_em_uso[tabela1]--;
+			continue;
+		}
+		if((pte1 & PTE_HUGE) && !dividir_pagina_grande(tabela1, i))
+		{
+			LOG_ERRO("Erro: Não há memória para dividir a página grande da entrada 0x%X da TABELA 1\n", i);
+			continue;
+		}
+		if((pte1 & PTE_COW) && referencias[PTEFRAME(pte1)] && primeira <= (i << 8) && ultima >= (i << 8 | 0xFF))
+		{
+			// Tabela 2 compartilhada inteira no intervalo: o processo só deixa de usá-la.
+			if(por_pagina)
+			{
+				dccvmm_tlb_flush(tabela1);
+			}
+			referencias[PTEFRAME(pte1)]--;
+			__frames[tabela1].words[i] = 0x0;
+			entradas_em_uso[tabela1]--;
+			continue;
+		}
+		if((pte1 & PTE_COW) && !separar_tabela2(tabela1, i))
+		{
+			LOG_ERRO("Erro: Não há memória para separar a tabela de páginas compartilhada da entrada 0x%X da TABELA 1\n", i);
+			continue;
+		}
+		uint32_t frame_tabela2 = PTEFRAME(__frames[tabela1].words[i]);
+		if(frame_tabela2 == 0x0)
+		{
+			continue;
+		}
+		uint32_t *tabela2 = __frames[frame_tabela2].words;
+		uint32_t fim = (i == (ultima >> 8)) ? (ultima & 0xFF) : 0xFF;
+		for(j = (i == (primeira >> 8)) ? (primeira & 0xFF) : 0x0; j <= fim && entradas_em_uso[frame_tabela2]; j++)
+		{
+			if(tabela2[j] == 0x0)
+			{
+				continue;
+			}
+			uint32_t frame = descartar_pagina(frame_tabela2, j);
+			if(por_pagina)
+			{
+				dccvmm_tlb_invalidate(tabela1, (i << 16) | (j << 8));
+			}
+			if(frame)
+			{
+				acrescentar_lote(lote, frame);
+			}
+			entradas_em_uso[frame_tabela2]--;
+		}
+		if(entradas_em_uso[frame_tabela2] == 0)
+		{
+			acrescentar_lote(lote, frame_tabela2);
+			ESTAT_DEC(frames_tabelas);
+			__frames[tabela1].words[i] = 0x0;
+			dccvmm_psc_invalidate(tabela1, i);
+			entradas_em_uso[tabela1]--;
+		}
+	}
+}
+
+// Libera a tabela de páginas 1, já vazia, do processo pid e a linha dele na tabela de sistema:
+static void liberar_tabela1(uint32_t pid, uint32_t tabela1){
+	// Se tabela de páginas 1 ficar vazia, libera a tabela de páginas 1 da memoria de dados:
+	liberar_frame_dados(tabela1);
+	ESTAT_DEC(frames_tabelas);
+	// Apaga a entrada da tabela de páginas 1 na tabela de sistema, liberando memória para processos futuros:
+	liberar_linha_sistema(pid);
+	// O frame da tabela 1 pode ser reaproveitado por outro processo, então nenhuma tradução marcada com ele pode sobrar na TLB:
+	dccvmm_tlb_flush(tabela1);
+	// Redefine o apontador global da tabela de páginas 1 do processo atual de modo que não haja acesso inválido enquanto outro processo não alocar memória ou houver um swap:
+	if(pid == id_processos)
+	{
+		__pagetable = 0x0;
+	}
+}
+
+// Prepara um frame que passou a guardar uma tabela de páginas. O frame pode ter vindo de um despejo ou de um free e ainda ter os dados
+// de outra página, que seriam lidos como ptes:
+static void nova_tabela(uint32_t frame){
+	dccvmm_zero(frame);
+	entradas_em_uso[frame] = 0;
+	ESTAT_INC(frames_tabelas);
+	ESTAT_PICO(pico_frames_tabelas, frames_tabelas);
+}
+
+// Página virtual do pte no local:
+static uint32_t pagina_do_local(uint32_t local){
+	return indice_da_tabela2[local >> 8] << 8 | (local & 0xFF);
+}
+
+// Local do pte dono do frame:
+static uint32_t local_do_dono(uint32_t frame){
+	return LOCAL(dono_do_frame[frame].tabela2, dono_do_frame[frame].pagina & 0xFF);
+}
+
+// Local seguinte do anel percorrido a partir de inicio, ou 0 quando o anel acaba (logo depois de inicio, se o pte não é compartilhado):
+static uint32_t seguinte_no_anel(uint32_t local, uint32_t inicio){
+	uint32_t seguinte = anel_compartilhamento[local];
+	return seguinte == inicio ? 0x0 : seguinte;
+}
+
+// Põe o pte do local "novo" no anel do pte do local "existente", criando o anel se o pte existente ainda não era compartilhado:
+static void entrar_no_anel(uint32_t existente, uint32_t novo){
+	uint32_t seguinte = anel_compartilhamento[existente];
+	anel_compartilhamento[existente] = novo;
+	anel_compartilhamento[novo] = seguinte ? seguinte : existente;
+}
+
+// Tira o pte do local do seu anel e retorna um local que continua nele (0 se o pte não era compartilhado). Um anel que fica com um pte só
+// deixa de existir:
+static uint32_t sair_do_anel(uint32_t local){
+	uint32_t seguinte = anel_compartilhamento[local];
+	uint32_t anterior = seguinte;
+	if(seguinte == 0x0)
+	{
+		return 0x0;
+	}
+	while(anel_compartilhamento[anterior] != local)
+	{
+		anterior = anel_compartilhamento[anterior];
+	}
+	anel_compartilhamento[anterior] = (anterior == seguinte) ? 0x0 : seguinte;
+	anel_compartilhamento[local] = 0x0;
+	return seguinte;
+}
+
+// O pte do local deixa de usar o frame compartilhado: sai do anel e passa PTE_DIRTY para um pte que fica, pois a cópia no disco não vale
+// para nenhum deles. Se o pte era o dono, o frame passa para esse outro pte, sem sair da política de substituição.
+static void deixar_frame_compartilhado(uint32_t frame, uint32_t local){
+	uint32_t outro = sair_do_anel(local);
+	*PTE_DO_LOCAL(outro) |= *PTE_DO_LOCAL(local) & PTE_DIRTY;
+	referencias[frame]--;
+	if(local_do_dono(frame) == local)
+	{
+		dono_do_frame[frame].tabela2 = outro >> 8;
+		dono_do_frame[frame].pagina = pagina_do_local(outro);
+	}
+}
+
+// Aponta para o frame, recém-lido do setor, o pte do local e os outros ptes do anel do setor, e faz do pte do local o dono do frame.
+// O setor continua reservado: enquanto a página não for modificada, ele é uma cópia válida e o próximo despejo não precisa gravar nada.
+// A página recém-carregada está limpa; o bit de referência é ligado pelo controlador quando o acesso for refeito.
+static void mapear_carregada(uint32_t local, uint32_t pagina, uint32_t frame, uint32_t setor){
+	uint32_t atual;
+	for(atual = local; atual; atual = seguinte_no_anel(atual, local))
+	{
+		uint32_t *pte = PTE_DO_LOCAL(atual);
+		*pte = (*pte & 0xFFF00000 & ~(PTE_DIRTY | PTE_ACCESSED)) | PTE_INMEM | (atual & 0xFF) << 12 | frame;
+		referencias[frame] += (atual != local);
+	}
+	setor_do_frame[frame] = setor;
+	dono_do_frame[frame].tabela2 = local >> 8;
+	dono_do_frame[frame].pagina = pagina;
+	politica->carregada(frame);
+}
+
+// Diz se o setor já está entre os n primeiros de setores:
+static int setor_pedido(uint32_t setor, const uint32_t *setores, uint32_t n){
+	uint32_t i;
+	for(i = 0; i < n && setores[i] != setor; i++);
+	return i < n;
+}
+
+// Pte da tabela 2 que aponta para o frame de dados, ou NULL se o frame não contém uma página que possa ser despejada. Se a página é
+// compartilhada, o pte é o do dono e recebe os bits de referência e de modificação dos outros ptes do anel, para que a política de
+// substituição decida pelo anel inteiro:
+uint32_t *pte_do_frame(uint32_t frame){
+	uint32_t frame_tabela2 = dono_do_frame[frame].tabela2;
+	if(frame_tabela2 == 0x0)
+	{
+		return NULL;
+	}
+	uint32_t inicio = local_do_dono(frame), local;
+	uint32_t *pte = PTE_DO_LOCAL(inicio);
+	for(local = seguinte_no_anel(inicio, inicio); local; local = seguinte_no_anel(local, inicio))
+	{
+		*pte |= *PTE_DO_LOCAL(local) & (PTE_ACCESSED | PTE_DIRTY);
+	}
+	return pte;
+}
+
+// Desliga os bits nos ptes de todas as páginas que estão no frame:
+static void desligar_no_anel(uint32_t frame, uint32_t bits){
+	uint32_t inicio = local_do_dono(frame), local;
+	for(local = inicio; local; local = seguinte_no_anel(local, inicio))
+	{
+		*PTE_DO_LOCAL(local) &= ~bits;
+	}
+}
+
+// Tira da TLB as traduções das páginas que estão no frame. Se a tabela 2 de uma delas é compartilhada (os_fork), a tradução sai de todas
+// as tabelas de páginas:
+static void invalidar_frame(uint32_t frame){
+	uint32_t inicio = local_do_dono(frame), local;
+	for(local = inicio; local; local = seguinte_no_anel(local, inicio))
+	{
+		uint32_t tabela1 = dono_da_tabela2[local >> 8];
+		if(tabela1)
+		{
+			dccvmm_tlb_invalidate(tabela1, pagina_do_local(local) << 8);
+		}
+		else
+		{
+			dccvmm_tlb_invalidate_page(pagina_do_local(local) << 8);
+		}
+	}
+}
+
+// Conta a página trazida por leitura antecipada que já foi referenciada; chamada antes de o bit de referência ser desligado. A marca sai
+// na primeira referência ou quando a página deixa o frame:
+static void conferir_antecipada(uint32_t frame, uint32_t pte){
+	if(antecipada[frame] && (pte & PTE_ACCESSED))
+	{
+		ESTAT_INC(antecipadas_usadas);
+	}
+	antecipada[frame] = 0;
+}
+
+// Desliga o bit de referência da página que está no frame. A tradução sai da TLB para que o próximo acesso ligue o bit de novo:
+void limpar_referencia(uint32_t frame){
+	uint32_t *pte = pte_do_frame(frame);
+	if(pte && (*pte & PTE_ACCESSED))
+	{
+		conferir_antecipada(frame, *pte);
+		desligar_no_anel(frame, PTE_ACCESSED);
+		invalidar_frame(frame);
+	}
+}
+
+// Grava no disco a página modificada que está no frame e desliga PTE_DIRTY, sem tirá-la da memória; um despejo futuro não precisará gravá-la.
+// Retorna 0 se não houver espaço no disco.
+uint32_t limpar_pagina(uint32_t frame){
+	uint32_t *pte = pte_do_frame(frame);
+	if(pte == NULL || !(*pte & PTE_DIRTY))
+	{
+		return 1;
+	}
+	if(setor_do_frame[frame])
+	{
+		disco_gravar(frame, setor_do_frame[frame]);
+	}
+	else
+	{
+		uint32_t setor = dump_setor_livre(frame);
+		if(setor == VM_ABORT)
+		{
+			return 0;
+		}
+		setor_do_frame[frame] = setor;
+	}
+	ESTAT_INC(escritas_paginas);
+	desligar_no_anel(frame, PTE_DIRTY);
+	invalidar_frame(frame);
+	return 1;
+}
+
+// Liga as páginas grandes em os_alloc_range; deve ser chamada antes de os_init:
+void os_paginas_grandes(int ligar){
+	paginas_grandes = ligar;
+}
+
+// Liga a alocação preguiçosa (frame só no primeiro acesso, leituras no frame zero); deve ser chamada antes de os_init:
+void os_alocacao_preguicosa(int ligar){
+	alocacao_preguicosa = ligar;
+}
+
+// Liga o conjunto de trabalho: os_swap anota as páginas usadas pelo processo que sai e traz de volta as do processo que entra:
+void os_conjunto_trabalho(int ligar){
+	conjunto_trabalho = ligar;
+}
+
+// Quantidade de páginas da leitura antecipada (0 desliga):
+void os_antecipacao(uint32_t paginas){
+	antecipacao = paginas < MAX_ANTECIPACAO ? paginas : MAX_ANTECIPACAO;
+}
+
+// Escolhe a política de substituição de páginas; deve ser chamada antes de os_init:
+void os_politica(const struct politica_substituicao *p){
+	politica = p;
+}
+
+// Imprime em stderr os contadores da paginação:
+void os_relatorio(void){
+	uint64_t acessos = estat.leituras + estat.escritas;
+	fprintf(stderr, "paginacao %s: acessos %" PRIu64 " faltas de pagina %" PRIu64 " (%.4f%%) despejos %" PRIu64 " escritas no disco %" PRIu64 " escritas evitadas %" PRIu64 " escritas do mapa do disco %" PRIu64 "\n",
+		politica->nome, acessos, estat.paginas_carregadas, acessos ? 100.0 * estat.paginas_carregadas / acessos : 0.0, estat.despejos, estat.escritas_paginas, estat.escritas_evitadas, estat.escritas_mapa_disco);
+	fprintf(stderr, "memoria: paginas alocadas %" PRIu64 " residentes %" PRIu64 " (%.2f%%) frames ocupados %" PRIu64 " paginas zeradas %" PRIu64 " leituras da pagina zero %" PRIu64 "\n",
+		estat.paginas_alocadas, estat.paginas_residentes, estat.paginas_alocadas ? 100.0 * estat.paginas_residentes / estat.paginas_alocadas : 0.0,
+		estat.frames_ocupados, estat.paginas_zeradas, estat.leituras_pagina_zero);
+	fprintf(stderr, "disco: pedidos %" PRIu64 " setores gravados %" PRIu64 " lidos %" PRIu64 " (da fila %" PRIu64 ") espera %.3f ms leituras antecipadas %" PRIu64 " (usadas %" PRIu64 ")\n",
+		estat.pedidos_disco, estat.setores_gravados, estat.setores_lidos, estat.leituras_da_fila, estat.espera_disco_us / 1000.0,
+		estat.leituras_antecipadas, estat.antecipadas_usadas);
+	fprintf(stderr, "conjunto de trabalho: paginas trazidas na troca de processo %" PRIu64 "\n", estat.paginas_na_troca);
+	fprintf(stderr, "mesclagem: passos %" PRIu64 " paginas examinadas %" PRIu64 " mescladas %" PRIu64 " (no frame zero %" PRIu64 ") frames recuperados %" PRIu64 " (ainda compartilhados no fim %" PRIu64 ")\n",
+		estat.passos_mesclagem, estat.paginas_examinadas, estat.paginas_mescladas, estat.mescladas_no_zero, estat.paginas_mescladas + estat.mescladas_no_zero,
+		estat.frames_poupados_mesclagem);
+	uint64_t leituras = estat.leituras_comprimidas + estat.leituras_da_fila + estat.setores_lidos;
+	fprintf(stderr, "cache comprimido: paginas guardadas %" PRIu64 " (compressao %.2f:1) recusadas %" PRIu64 " expulsas para o disco %" PRIu64
+		" leituras %" PRIu64 " (%.2f%% das leituras) setores poupados ao disco %" PRIu64 "\n",
+		estat.paginas_comprimidas, estat.bytes_comprimidos ? (double) estat.paginas_comprimidas * sizeof(struct frame) / estat.bytes_comprimidos : 0.0,
+		estat.recusadas_compressao, estat.expulsas_comprimidas, estat.leituras_comprimidas, leituras ? 100.0 * estat.leituras_comprimidas / leituras : 0.0,
+		estat.paginas_comprimidas - estat.expulsas_comprimidas + estat.leituras_comprimidas);
+	if(estat.descartes_falhos)
+	{
+		fprintf(stderr, "disco: %" PRIu64 " descartes de setores livres recusados pelo hospedeiro; a memoria deles nao foi devolvida\n", estat.descartes_falhos);
+	}
+}
+
+// Conta nas tabelas de páginas de todos os processos as páginas alocadas e as que têm um frame próprio na memória (as mapeadas no frame zero
+// e as despejadas para o disco não contam como residentes):
+void os_contar_paginas(void){
+	uint64_t alocadas = 0, residentes = 0;
+	uint32_t pid, i, k;
+	dccvmm_pt_lock();
+	for(pid = 1; pid <= MAX_PID; pid++)
+	{
+		uint32_t linha = linha_do_processo[pid];
+		uint32_t tabela1 = linha ? PTEFRAME(PALAVRA_SISTEMA(linha)) : 0x0;
+		if(tabela1 == 0x0)
+		{
+			continue;
+		}
+		for(i = 0; i < TAMANHO_FRAME; i++)
+		{
+			uint32_t pte1 = __frames[tabela1].words[i];
+			if(pte1 & PTE_HUGE)
+			{
+				alocadas += HUGE_FRAMES;
+				residentes += HUGE_FRAMES;
+				continue;
+			}
+			if(PTEFRAME(pte1) == 0x0)
+			{
+				continue;
+			}
+			for(k = 0; k < TAMANHO_FRAME; k++)
+			{
+				uint32_t pte = __frames[PTEFRAME(pte1)].words[k];
+				if(pte == 0x0)
+				{
+					continue;
+				}
+				alocadas++;
+				if((pte & PTE_INMEM) && PTEFRAME(pte) != frame_zero)
+				{
+					residentes++;
+				}
+			}
+		}
+	}
+	estat.paginas_alocadas = alocadas;
+	estat.paginas_residentes = residentes;
+	estat.frames_ocupados = NUMFRAMES - frames_livres_dados();
+	for(i = 0, k = 0; i < NUMFRAMES; i++)
+	{
+		k += mesclado[i] ? referencias[i] : 0;
+	}
+	estat.frames_poupados_mesclagem = k;
+	dccvmm_pt_unlock();
+}
+
+/* Estado do sistema guardado entre execuções, ao lado da imagem do disco: a memória física (com as tabelas de páginas e a tabela de sistema),
+ * as estruturas do sistema operacional que não estão nela e os contadores. O índice da tabela de sistema é reconstruído a partir da memória
+ * e a política de substituição recomeça com os frames que têm dono, sem o histórico de referências. */
+#define ASSINATURA_ESTADO 0x54503245 // "TP2E"
+
+struct parte_estado {
+	void *dados;
+	size_t tamanho;
+};
+
+// Preenche partes com as regiões gravadas no arquivo de estado, sempre na mesma ordem, e retorna quantas são:
+static uint32_t partes_do_estado(struct parte_estado *partes){
+	struct parte_estado lista[] = {
+		{ __frames, sizeof(__frames) },
+		{ dono_do_frame, sizeof(dono_do_frame) },
+		{ dono_da_tabela2, sizeof(dono_da_tabela2) },
+		{ referencias, sizeof(referencias) },
+		{ entradas_em_uso, sizeof(entradas_em_uso) },
+		{ setor_do_frame, sizeof(setor_do_frame) },
+		{ mapa_setores, sizeof(mapa_setores) },
+		{ &cursor_setores, sizeof(cursor_setores) },
+		{ &total_setores_livres, sizeof(total_setores_livres) },
+		{ &cursor_frames_livres, sizeof(cursor_frames_livres) },
+		{ &frame_zero, sizeof(frame_zero) },
+		{ anel_compartilhamento, sizeof(anel_compartilhamento) },
+		{ indice_da_tabela2, sizeof(indice_da_tabela2) },
+		{ mesclado, sizeof(mesclado) },
+		{ &id_processos, sizeof(id_processos) },
+		{ &estat, sizeof(estat) },
+	};
+	memcpy(partes, lista, sizeof(lista));
+	return sizeof(lista) / sizeof(lista[0]);
+}
+
+// Grava o estado do sistema em arquivo. Deve ser chamada com o sistema parado, depois de os_sincronizar. Retorna 0 em caso de sucesso:
+int os_salvar(const char *arquivo){
+	struct parte_estado partes[20];
+	uint32_t cabecalho[] = { ASSINATURA_ESTADO, NUMFRAMES, sizeof(estat) };
+	uint32_t total = partes_do_estado(partes), i;
+	// As páginas do cache comprimido só existem na memória:
+	disco_descarregar();
+	FILE *fd = fopen(arquivo, "wb");
+	if(!fd)
+	{
+		perror(arquivo);
+		return 1;
+	}
+	int erro = fwrite(cabecalho, sizeof(cabecalho), 1, fd) != 1;
+	for(i = 0; i < total && !erro; i++)
+	{
+		erro = fwrite(partes[i].dados, partes[i].tamanho, 1, fd) != 1;
+	}
+	if(fclose(fd) || erro)
+	{
+		LOG_ERRO("Erro: Não foi possível gravar o estado do sistema em %s\n", arquivo);
+		return 1;
+	}
+	return 0;
+}
+
+// Substitui os_init: recupera o estado gravado por os_salvar. O disco deve ser a imagem da mesma execução. Retorna 0 em caso de sucesso:
+int os_retomar(const char *arquivo){
+	struct parte_estado partes[20];
+	uint32_t cabecalho[3];
+	uint32_t total = partes_do_estado(partes), i, frame;
+	FILE *fd = fopen(arquivo, "rb");
+	if(!fd)
+	{
+		perror(arquivo);
+		return 1;
+	}
+	int erro = fread(cabecalho, sizeof(cabecalho), 1, fd) != 1
+		|| cabecalho[0] != ASSINATURA_ESTADO || cabecalho[1] != NUMFRAMES || cabecalho[2] != sizeof(estat);
+	for(i = 0; i < total && !erro; i++)
+	{
+		erro = fread(partes[i].dados, partes[i].tamanho, 1, fd) != 1;
+	}
+	fclose(fd);
+	if(erro)
+	{
+		LOG_ERRO("Erro: %s não é um estado do sistema válido\n", arquivo);
+		return 1;
+	}
+	total_frames_livres = 0;
+	for(i = INICIO_FRAMES_LIVRES; i <= FIM_FRAMES_LIVRES; i++)
+	{
+		total_frames_livres += 32 - __builtin_popcount(__frames[0].words[i]);
+	}
+	reconstruir_indice_sistema();
+	memset(setor_mapa_sujo, 0, sizeof(setor_mapa_sujo));
+	alteracoes_mapa_setores = 0;
+	politica->iniciar();
+	for(frame = 0; frame < NUMFRAMES; frame++)
+	{
+		if(dono_do_frame[frame].tabela2)
+		{
+			politica->carregada(frame);
+		}
+	}
+	if(alocacao_preguicosa && frame_zero == 0x0)
+	{
+		frame_zero = procurar_frame_livre_dados();
+		if(frame_zero)
+		{
+			dccvmm_zero(frame_zero);
+		}
+	}
+	// A TLB começa vazia; o processo corrente volta a usar a sua tabela de páginas:
+	uint32_t linha = linha_do_processo[id_processos];
+	__pagetable = linha ? PTEFRAME(PALAVRA_SISTEMA(linha)) : 0x0;
+	return 0;
+}
+
+// Devolve um frame ocupado. Com cache, o frame vai primeiro para o cache da thread; se o cache estiver cheio, os frames mais antigos
+// dele voltam para o mapa num lote:
+void liberar_frame_dados(uint32_t frame){
+	if(!cache_frames.ativo)
+	{
+		if(devolver_frames(&frame, 1))
+		{
+			ESTAT_INC(frames_liberados);
+		}
+		return;
+	}
+	if(cache_frames.total == CACHE_FRAMES)
+	{
+		devolver_frames(cache_frames.frames, LOTE_FRAMES);
+		memmove(cache_frames.frames, cache_frames.frames + LOTE_FRAMES, (CACHE_FRAMES - LOTE_FRAMES) * sizeof(uint32_t));
+		cache_frames.total -= LOTE_FRAMES;
+	}
+	cache_frames.frames[cache_frames.total++] = frame;
+	ESTAT_INC(frames_liberados);
+}
+
+// Devolve vários frames ocupados de uma vez:
+void liberar_frames_dados(const uint32_t *frames, uint32_t quantos){
+	uint32_t i;
+	if(cache_frames.ativo)
+	{
+		for(i = 0; i < quantos; i++)
+		{
+			liberar_frame_dados(frames[i]);
+		}
+		return;
+	}
+	ESTAT_ADD(frames_liberados, devolver_frames(frames, quantos));
+}
+
+// Quantidade de frames livres no mapa da memória de dados:
+uint32_t frames_livres_dados(void){
+	return __atomic_load_n(&total_frames_livres, __ATOMIC_RELAXED);
+}
+
+// Liga o cache de frames da thread que chama. Deve ser chamada por cada thread que vai usar o sistema operacional em paralelo:
+void os_iniciar_thread(void){
+	cache_frames.total = 0;
+	cache_frames.ativo = 1;
+}
+
+// Devolve ao mapa os frames do cache da thread e desliga o cache; deve ser chamada antes de a thread terminar:
+void os_encerrar_thread(void){
+	devolver_frames(cache_frames.frames, cache_frames.total);
+	cache_frames.total = 0;
+	cache_frames.ativo = 0;
+}
+
+// Procura a linha da tabela de sistema do processo atual e carrega sua tabela de páginas 1. Se o processo não tiver linha, reserva uma linha livre para ele.
+// As duas buscas são feitas em tempo constante pelo índice por id de processo e pela pilha de linhas livres.
+uint32_t procurar_frame_sistema(void){
+	uint32_t tabela1 = 0x0;
+	uint32_t linha = linha_do_processo[id_processos];
+	if(linha)
+	{
+		LOG_DEPURACAO("OS DADOS DA TABELA 1 foram encontrados na linha %i DA TABELA DE SISTEMA\n", linha);
+		// Seta variável global com o frame da tabela de pagina 1 do processo atual:
+		tabela1 = PTEFRAME(PALAVRA_SISTEMA(linha));
+	}
+	else if(total_linhas_livres)
+	{
+		LOG_DEPURACAO("NÃO foram encontradas as informações da TABELA 1 do PROCESSO %i NA TABELA DE SISTEMA.\n", id_processos);
+		linha = linhas_livres[--total_linhas_livres];
+		LOG_DEPURACAO("OS DADOS DA TABELA 1 DO PROCESSO %i serão inseridos na linha 0X%X DA TABELA DE SISTEMA\n", id_processos, linha);
+		PALAVRA_SISTEMA(linha) = (id_processos << 24);
+		linha_do_processo[id_processos] = linha;
+	}
+	else
+	{
+		LOG_DEPURACAO("NÃO foram encontradas as informações da TABELA 1 do PROCESSO %i NA TABELA DE SISTEMA.\n", id_processos);
+	}
+	dccvmm_set_page_table(tabela1);
+	return linha;
+}
+
+// Reconstrói o índice por id de processo e a pilha de linhas livres a partir da tabela de sistema na memória:
+void reconstruir_indice_sistema(void){
+	uint32_t linha;
+	memset(linha_do_processo, 0, sizeof(linha_do_processo));
+	total_linhas_livres = 0;
+	// Empilha de trás para frente para que as linhas mais baixas sejam usadas primeiro:
+	for(linha = FIM_TABELA_SISTEMA; linha >= INICIO_TABELA_SISTEMA; linha--)
+	{
+		uint32_t entrada = PALAVRA_SISTEMA(linha);
+		if(entrada == 0x0)
+		{
+			linhas_livres[total_linhas_livres++] = linha;
+		}
+		else
+		{
+			linha_do_processo[entrada >> 24] = linha;
+		}
+	}
+}
+
+// Apaga a linha da tabela de sistema do processo e a devolve à pilha de linhas livres:
+void liberar_linha_sistema(uint32_t pid){
+	uint32_t linha = linha_do_processo[pid];
+	if(linha)
+	{
+		LOG_DEPURACAO("A entrada na tabela de sistema 0x%X = 0x%X referente à TABELA 1 será apagada\n", linha, PALAVRA_SISTEMA(linha));
+		PALAVRA_SISTEMA(linha) = 0x0;
+		linha_do_processo[pid] = 0;
+		linhas_livres[total_linhas_livres++] = linha;
+	}
+}
+
+// Grava o frame no primeiro setor livre do disco, marca o setor como ocupado e retorna seu número:
+uint32_t dump_setor_livre (uint32_t frame) {
+    uint32_t setor = alocar_setor();
+    if (setor != VM_ABORT) {
+        disco_gravar(frame, setor);
+    }
+    return setor;
+}
+
+// Diz se estão livres no mapa residente todos os "quantos" setores (potência de 2) do grupo alinhado que contém o setor:
+static int grupo_setores_livre(uint32_t setor, uint32_t quantos) {
+    uint32_t primeiro = setor & ~(quantos - 1), i;
+    if (quantos < 0x20) return !(mapa_setores[setor / 0x20] & (((0x1u << quantos) - 1) << (primeiro % 0x20)));
+    for (i = primeiro / 0x20; i < (primeiro + quantos) / 0x20; i++) {
+        if (mapa_setores[i]) return 0;
+    }
+    return 1;
+}
+
+// Reserva um setor livre no mapa residente: a busca começa no cursor, pula palavras cheias e acha o bit com count-trailing-zeros.
+// Como liberar_setor puxa o cursor para o setor liberado mais baixo, os setores usados ficam juntos no começo do disco e os setores
+// nunca gravados, que não ocupam memória, só são tocados quando os liberados acabam.
+uint32_t alocar_setor (void) {
+    uint32_t n;
+    uint32_t setor = VM_ABORT;
+
+    uint32_t i = cursor_setores;
+    for (n = 0; total_setores_livres && n < PALAVRAS_MAPA_SETORES; n++) {
+        if (mapa_setores[i] != 0xFFFFFFFF) {
+            uint32_t k = __builtin_ctz(~mapa_setores[i]);
+            mapa_setores[i] |= 0x00000001u << k; // Set used
+            cursor_setores = i;
+            total_setores_livres--;
+            setor_mapa_sujo[i / TAMANHO_FRAME] = 1;
+            if (++alteracoes_mapa_setores >= LOTE_MAPA_SETORES) sincronizar_mapa_setores();
+            setor = k + (i * 0x20);
+            break;
+        }
+        i = (i + 1) % PALAVRAS_MAPA_SETORES;
+    }
+    if (setor == VM_ABORT) LOG_ERRO("Erro: Acabou o espaço em disco.\n");
+    return setor;
+}
+
+void liberar_setor (uint32_t setor) {
+    uint32_t mask = 0x00000001u << (setor % 0x20);
+
+    if (mapa_setores[setor / 0x20] & mask) {
+        mapa_setores[setor / 0x20] &= ~mask; // Set unused
+        total_setores_livres++;
+        setor_mapa_sujo[setor / (0x20 * TAMANHO_FRAME)] = 1;
+        if (++alteracoes_mapa_setores >= LOTE_MAPA_SETORES) sincronizar_mapa_setores();
+        if (setor / 0x20 < cursor_setores) cursor_setores = setor / 0x20;
+        // Com o grupo do setor todo livre, a página do hospedeiro que o guarda é devolvida (ainda com a trava, antes que outro a reserve).
+        // Uma recusa do hospedeiro só deixa a memória ocupada e é contada por dccvmm_discard_sectors.
+        uint32_t grupo = dccvmm_discard_unit();
+        if (grupo_setores_livre(setor, grupo)) dccvmm_discard_sectors(setor & ~(grupo - 1), grupo);
+    }
+    disco_descartar(setor);
+}
+
+// Grava no disco os setores do mapa residente que foram alterados, usando o frame 1 como área de transferência.
+// Chamada com a trava das tabelas de páginas (ou antes de existirem outras threads):
+void sincronizar_mapa_setores (void) {
+    uint32_t i;
+
+    for (i = 0; i < SETORES_MAPA; i++) {
+        if (!setor_mapa_sujo[i]) continue;
+        memcpy(&(__frames[1]), &mapa_setores[i * TAMANHO_FRAME], sizeof (__frames[1]));
+        disco_gravar_mapa(0x1, i); // Push updated usage
+        setor_mapa_sujo[i] = 0;
+        ESTAT_INC(escritas_mapa_disco);
+    }
+    dccvmm_zero(1);
+    alteracoes_mapa_setores = 0;
+}
+
+// Grava no disco o estado do sistema que ainda está só na memória (o mapa de setores):
+void os_sincronizar (void) {
+    dccvmm_pt_lock();
+    sincronizar_mapa_setores();
+    dccvmm_pt_unlock();
+    disco_esvaziar();
+}
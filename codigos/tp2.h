@@ -1,11 +1,50 @@
 #ifndef TPSO2_tp2_h
 #define TPSO2_tp2_h
 
+#include <inttypes.h>
+
 // Cabeçalho das funções:
 void os_init(void);
 uint32_t os_pagefault(uint32_t address, uint32_t perms, uint32_t pte);
 void os_alloc(uint32_t virtaddr);
+void os_alloc_range(uint32_t inicio, uint32_t paginas);
+// Liga ou desliga as páginas grandes (PTE_HUGE) em os_alloc_range:
+void os_paginas_grandes(int ligar);
+// Liga ou desliga a alocação preguiçosa (frame só no primeiro acesso, leituras no frame zero):
+void os_alocacao_preguicosa(int ligar);
+// Liga o conjunto de trabalho por processo, recarregado de uma vez em os_swap:
+void os_conjunto_trabalho(int ligar);
+// Quantidade de páginas seguintes trazidas do disco junto com a página de uma falta (0 desliga):
+void os_antecipacao(uint32_t paginas);
+// Mesclagem de páginas iguais: a cada intervalo chamadas de os_swap, examina os próximos frames frames (0 desliga):
+void os_mesclagem(uint32_t frames, uint32_t intervalo);
+// Conta as páginas alocadas e residentes para o relatório do fim da execução:
+void os_contar_paginas(void);
+// Grava o estado do sistema num arquivo; os_retomar o recupera no lugar de os_init, com o disco da mesma execução:
+int os_salvar(const char *arquivo);
+int os_retomar(const char *arquivo);
 void os_free(uint32_t virtaddr);
+void os_free_range(uint32_t inicio, uint32_t fim);
+void os_exit(uint32_t pid);
+void os_fork(uint32_t pai, uint32_t filho);
 void os_swap(uint32_t pid);
+void os_sincronizar(void);
+
+// Alocador de frames da memória de dados:
+uint32_t procurar_frame_livre_dados(void);
+void liberar_frame_dados(uint32_t frame);
+void liberar_frames_dados(const uint32_t *frames, uint32_t quantos);
+uint32_t frames_livres_dados(void);
+// Cache de frames por thread, para as threads que usam o sistema operacional em paralelo:
+void os_iniciar_thread(void);
+void os_encerrar_thread(void);
+
+// Interface com as políticas de substituição de páginas:
+struct politica_substituicao;
+void os_politica(const struct politica_substituicao *p);
+uint32_t *pte_do_frame(uint32_t frame);
+void limpar_referencia(uint32_t frame);
+uint32_t limpar_pagina(uint32_t frame);
+void os_relatorio(void);
 
 #endif
@@ -0,0 +1,413 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "trace.h"
+#include "tp2.h"
+#include "vmm.h"
+#include "log.h"
+#include "estatisticas.h"
+#include "analise.h"
+
+#define BUFSZ 1024
+
+int traduzir_linha(const char *linha, uint32_t *endereco, uint32_t *dado){
+	unsigned a = 0, d = 0;
+	if(linha[0] == '#') return TRACE_NENHUM;
+
+	if(!strncmp(linha, "alloc_range", 11)) {
+		sscanf(linha, "alloc_range %x %u\n", &a, &d);
+		*endereco = a;
+		*dado = d;
+		return TRACE_ALLOC_RANGE;
+	} else if(!strncmp(linha, "alloc", 5)) {
+		sscanf(linha, "alloc %x\n", &a);
+		*endereco = a;
+		return TRACE_ALLOC;
+	} else if(!strncmp(linha, "free_range", 10)) {
+		sscanf(linha, "free_range %x %x\n", &a, &d);
+		*endereco = a;
+		*dado = d;
+		return TRACE_FREE_RANGE;
+	} else if(!strncmp(linha, "free", 4)) {
+		sscanf(linha, "free %x\n", &a);
+		*endereco = a;
+		return TRACE_FREE;
+	} else if(!strncmp(linha, "read", 4)) {
+		sscanf(linha, "read %x\n", &a);
+		*endereco = a;
+		return TRACE_READ;
+	} else if(!strncmp(linha, "write", 5)) {
+		sscanf(linha, "write %x %x\n", &a, &d);
+		*endereco = a;
+		*dado = d;
+		return TRACE_WRITE;
+	} else if(!strncmp(linha, "swap", 4)) {
+		sscanf(linha, "swap %u\n", &d);
+		*dado = d;
+		return TRACE_SWAP;
+	} else if(!strncmp(linha, "fork", 4)) {
+		sscanf(linha, "fork %u %u\n", &a, &d);
+		*endereco = a;
+		*dado = d;
+		return TRACE_FORK;
+	} else if(!strncmp(linha, "exit", 4)) {
+		sscanf(linha, "exit %u\n", &d);
+		*dado = d;
+		return TRACE_EXIT;
+	}
+	return TRACE_NENHUM;
+}
+
+void executar_comando(int comando, uint32_t endereco, uint32_t dado){
+	switch(comando) {
+	case TRACE_ALLOC:
+		os_alloc(endereco);
+		break;
+	case TRACE_FREE:
+		if(analise_ligada) analise_free(endereco);
+		os_free(endereco);
+		break;
+	case TRACE_READ:
+		if(analise_ligada) analise_acesso(endereco);
+		dccvmm_read(endereco);
+		break;
+	case TRACE_WRITE:
+		if(analise_ligada) analise_acesso(endereco);
+		dccvmm_write(endereco, dado);
+		break;
+	case TRACE_SWAP:
+		if(analise_ligada) analise_troca(dado);
+		os_swap(dado);
+		break;
+	case TRACE_EXIT:
+		if(analise_ligada) analise_exit(dado);
+		os_exit(dado);
+		break;
+	case TRACE_FREE_RANGE:
+		if(analise_ligada) analise_free_range(endereco, dado);
+		os_free_range(endereco, dado);
+		break;
+	case TRACE_ALLOC_RANGE:
+		os_alloc_range(endereco, dado);
+		break;
+	case TRACE_FORK:
+		os_fork(endereco, dado);
+		break;
+	}
+}
+
+void terminar_juntando(struct juncao *j){
+	if(j->paginas == 1) {
+		os_alloc(j->inicio);
+	} else if(j->paginas) {
+		os_alloc_range(j->inicio, j->paginas);
+	}
+	j->paginas = 0;
+}
+
+void executar_juntando(struct juncao *j, int comando, uint32_t endereco, uint32_t dado){
+	// Só allocs alinhados e dentro do espaço de endereçamento entram na junção; os demais seguem para os_alloc, que os recusa.
+	if(comando == TRACE_ALLOC && !(endereco & 0xFF) && endereco <= 0xFFFFFF) {
+		if(j->paginas && endereco == j->inicio + (j->paginas << 8)) {
+			j->paginas++;
+			return;
+		}
+		terminar_juntando(j);
+		j->inicio = endereco;
+		j->paginas = 1;
+		return;
+	}
+	terminar_juntando(j);
+	executar_comando(comando, endereco, dado);
+}
+
+int reproduzir_texto(FILE *entrada){
+	char linha[BUFSZ];
+	struct juncao j = { 0, 0 };
+	while(fgets(linha, BUFSZ, entrada)) {
+		uint32_t endereco = 0, dado = 0;
+		int comando = traduzir_linha(linha, &endereco, &dado);
+		if(comando != TRACE_NENHUM) executar_juntando(&j, comando, endereco, dado);
+	}
+	terminar_juntando(&j);
+	return 0;
+}
+
+/* Mapeia o arquivo binário na memória e confere o cabeçalho. Em caso de sucesso, *tamanho recebe o tamanho do mapeamento (para munmap)
+ * e o endereço do cabeçalho é retornado; em caso de erro, retorna NULL. */
+static const struct trace_cabecalho *mapear_binario(const char *arquivo, size_t *tamanho){
+	int fd = open(arquivo, O_RDONLY);
+	struct stat st;
+	if(fd < 0 || fstat(fd, &st) < 0) {
+		perror(arquivo);
+		if(fd >= 0) close(fd);
+		return NULL;
+	}
+	if((size_t) st.st_size < sizeof(struct trace_cabecalho)) {
+		fprintf(stderr, "%s: arquivo de acessos binario invalido\n", arquivo);
+		close(fd);
+		return NULL;
+	}
+	void *mapa = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(mapa == MAP_FAILED) {
+		perror(arquivo);
+		return NULL;
+	}
+	posix_madvise(mapa, st.st_size, POSIX_MADV_SEQUENTIAL);
+
+	const struct trace_cabecalho *cab = mapa;
+	if(memcmp(cab->magica, TRACE_MAGICA, sizeof(cab->magica)) || cab->versao != TRACE_VERSAO
+			|| cab->ordem != TRACE_ORDEM
+			|| cab->registros != (st.st_size - sizeof(*cab)) / sizeof(struct trace_registro)) {
+		fprintf(stderr, "%s: arquivo de acessos binario invalido\n", arquivo);
+		munmap(mapa, st.st_size);
+		return NULL;
+	}
+	*tamanho = st.st_size;
+	return cab;
+}
+
+/* O arquivo binário é mapeado na memória e os registros são despachados direto do mapeamento, sem cópia nem análise de texto. */
+int reproduzir_binario(const char *arquivo){
+	size_t tamanho;
+	const struct trace_cabecalho *cab = mapear_binario(arquivo, &tamanho);
+	if(!cab) return -1;
+	const struct trace_registro *r = (const struct trace_registro *) (cab + 1);
+	const struct trace_registro *fim = r + cab->registros;
+	struct juncao j = { 0, 0 };
+	for(; r < fim; r++) {
+		executar_juntando(&j, REGISTRO_COMANDO(r), REGISTRO_ENDERECO(r), r->dado);
+	}
+	terminar_juntando(&j);
+	munmap((void *) cab, tamanho);
+	return 0;
+}
+
+/* Monta o registro binário da linha de texto número "numero". Retorna 1 se a linha tem um comando, 0 se deve ser ignorada e -1 se o endereço
+ * não cabe no registro. */
+static int montar_registro(const char *linha, uint64_t numero, struct trace_registro *r){
+	uint32_t endereco = 0, dado = 0;
+	int comando = traduzir_linha(linha, &endereco, &dado);
+	if(comando == TRACE_NENHUM) return 0;
+	// Os enderecos virtuais da arquitetura tem 24 bits (vmm.h):
+	if(endereco > 0x00FFFFFF) {
+		fprintf(stderr, "linha %" PRIu64 ": endereco 0x%X fora do espaco de enderecamento\n", numero, endereco);
+		return -1;
+	}
+	r->comando_endereco = (uint32_t) comando << 24 | endereco;
+	r->dado = dado;
+	return 1;
+}
+
+int converter_trace(FILE *entrada, const char *saida){
+	char linha[BUFSZ];
+	uint64_t numero = 0;
+	struct trace_cabecalho cab;
+	FILE *fd = fopen(saida, "wb");
+	if(!fd) {
+		perror(saida);
+		return -1;
+	}
+	setvbuf(fd, NULL, _IOFBF, 1 << 20);
+	memcpy(cab.magica, TRACE_MAGICA, sizeof(cab.magica));
+	cab.versao = TRACE_VERSAO;
+	cab.ordem = TRACE_ORDEM;
+	cab.registros = 0;
+	int invalido = 0, erro;
+	// Uma escrita que falha liga o indicador de erro de fd, conferido antes de fechar:
+	fwrite(&cab, sizeof(cab), 1, fd);
+
+	while(!ferror(fd) && fgets(linha, BUFSZ, entrada)) {
+		struct trace_registro r;
+		int ok = montar_registro(linha, ++numero, &r);
+		if(ok == 0) continue;
+		if(ok < 0) {
+			invalido = 1;
+			break;
+		}
+		fwrite(&r, sizeof(r), 1, fd);
+		cab.registros++;
+	}
+	// O número de registros só é conhecido no fim:
+	if(!invalido && !ferror(fd)) {
+		rewind(fd);
+		fwrite(&cab, sizeof(cab), 1, fd);
+	}
+	erro = ferror(fd);
+	if(ferror(entrada)) {
+		fprintf(stderr, "erro na leitura do arquivo de acessos\n");
+		invalido = 1;
+	}
+	// Um arquivo incompleto não é deixado para trás (mas a saída pode ser um dispositivo, que não é apagado):
+	struct stat st;
+	int regular = fstat(fileno(fd), &st) == 0 && S_ISREG(st.st_mode);
+	if(fclose(fd)) erro = 1;
+	if(erro) perror(saida);
+	if(erro || invalido) {
+		if(regular) remove(saida);
+		return -1;
+	}
+	fprintf(stderr, "%" PRIu64 " registros gravados em %s\n", cab.registros, saida);
+	return 0;
+}
+
+/* Reprodução com várias threads: os comandos de cada processo formam um fluxo, e o fluxo do processo pid vai para a thread pid % threads
+ * (o filho de um fork vai para a thread do pai).
+ * A ordem dos comandos de um mesmo processo é mantida; a ordem entre processos diferentes não. Cada thread é uma CPU do controlador
+ * e faz a troca de contexto (os_swap) sempre que passa a executar comandos de outro processo. */
+struct fluxo {
+	pthread_t thread;
+	struct trace_registro *registros; // NULL na primeira passada, que só conta os registros
+	uint64_t total;
+	uint32_t pid;                     // processo dos últimos registros do fluxo
+	struct estatisticas estat;        // contadores da thread, somados aos da thread principal no fim
+};
+
+static void acrescentar(struct fluxo *f, uint32_t comando_endereco, uint32_t dado){
+	if(f->registros) {
+		f->registros[f->total].comando_endereco = comando_endereco;
+		f->registros[f->total].dado = dado;
+	}
+	f->total++;
+}
+
+static void distribuir(const struct trace_registro *r, uint64_t total, struct fluxo *fluxos, unsigned threads){
+	uint32_t pid = 1; // os_swap ainda não foi chamada: o processo corrente é o 1 (tp2.c)
+	unsigned rota[0x100]; // fluxo de cada processo
+	uint64_t i;
+	for(i = 0; i < 0x100; i++) rota[i] = i % threads;
+	for(i = 0; i < total; i++, r++) {
+		if(REGISTRO_COMANDO(r) == TRACE_NENHUM) continue;
+		// As trocas de processo válidas só mudam o fluxo dos próximos registros; as inválidas seguem para os_swap, que as recusa.
+		if(REGISTRO_COMANDO(r) == TRACE_SWAP && r->dado >= 1 && r->dado <= 0xFF) {
+			pid = r->dado;
+			continue;
+		}
+		// O fim de um processo vai para o fluxo dele, depois dos seus comandos, sem troca de contexto:
+		if(REGISTRO_COMANDO(r) == TRACE_EXIT && r->dado >= 1 && r->dado <= 0xFF) {
+			acrescentar(&fluxos[rota[r->dado]], r->comando_endereco, r->dado);
+			continue;
+		}
+		// O fork vai para o fluxo do pai, e o filho passa a ser executado nesse fluxo para que os comandos dele venham depois do fork:
+		if(REGISTRO_COMANDO(r) == TRACE_FORK && REGISTRO_ENDERECO(r) >= 1 && REGISTRO_ENDERECO(r) <= 0xFF && r->dado >= 1 && r->dado <= 0xFF) {
+			rota[r->dado] = rota[REGISTRO_ENDERECO(r)];
+			acrescentar(&fluxos[rota[r->dado]], r->comando_endereco, r->dado);
+			continue;
+		}
+		struct fluxo *f = &fluxos[rota[pid]];
+		if(f->pid != pid) {
+			acrescentar(f, (uint32_t) TRACE_SWAP << 24, pid);
+			f->pid = pid;
+		}
+		acrescentar(f, r->comando_endereco, r->dado);
+	}
+}
+
+static void *executar_fluxo(void *arg){
+	struct fluxo *f = arg;
+	uint64_t i;
+	struct juncao j = { 0, 0 };
+	dccvmm_cpu_start();
+	os_iniciar_thread();
+	for(i = 0; i < f->total; i++) {
+		const struct trace_registro *r = &f->registros[i];
+		executar_juntando(&j, REGISTRO_COMANDO(r), REGISTRO_ENDERECO(r), r->dado);
+	}
+	terminar_juntando(&j);
+	os_encerrar_thread();
+	f->estat = estat;
+	dccvmm_cpu_stop();
+	return NULL;
+}
+
+static int reproduzir_registros(const struct trace_registro *r, uint64_t total, unsigned threads){
+	struct fluxo *fluxos = calloc(threads, sizeof(*fluxos));
+	struct timespec inicio, fim;
+	unsigned t;
+	int erro = 0;
+	if(!fluxos) return -1;
+	distribuir(r, total, fluxos, threads);
+	for(t = 0; t < threads; t++) {
+		fluxos[t].registros = malloc(fluxos[t].total * sizeof(*r) + 1);
+		if(!fluxos[t].registros) erro = -1;
+		fluxos[t].total = 0;
+		fluxos[t].pid = 0;
+	}
+	if(!erro) {
+		distribuir(r, total, fluxos, threads);
+		clock_gettime(CLOCK_MONOTONIC, &inicio);
+		dccvmm_smp(1);
+		for(t = 0; t < threads; t++) {
+			if(pthread_create(&fluxos[t].thread, NULL, executar_fluxo, &fluxos[t])) {
+				perror("pthread_create");
+				abort();
+			}
+		}
+		for(t = 0; t < threads; t++) {
+			pthread_join(fluxos[t].thread, NULL);
+			estatisticas_somar(&fluxos[t].estat);
+		}
+		dccvmm_smp(0);
+		clock_gettime(CLOCK_MONOTONIC, &fim);
+		double segundos = (fim.tv_sec - inicio.tv_sec) + (fim.tv_nsec - inicio.tv_nsec) / 1e9;
+		uint64_t acessos = estat.leituras + estat.escritas;
+		if(log_nivel >= NIVEL_RESUMO)
+			fprintf(stderr, "paralelo %u threads: %" PRIu64 " acessos em %.3f s (%.0f acessos/s)\n",
+				threads, acessos, segundos, segundos > 0 ? acessos / segundos : 0.0);
+	}
+	for(t = 0; t < threads; t++) free(fluxos[t].registros);
+	free(fluxos);
+	return erro;
+}
+
+int reproduzir_paralelo(const char *arquivo, int binario, unsigned threads){
+	int erro;
+	if(binario) {
+		size_t tamanho;
+		const struct trace_cabecalho *cab = mapear_binario(arquivo, &tamanho);
+		if(!cab) return -1;
+		erro = reproduzir_registros((const struct trace_registro *) (cab + 1), cab->registros, threads);
+		munmap((void *) cab, tamanho);
+		return erro;
+	}
+	// O arquivo texto é convertido inteiro para registros na memória antes da distribuição:
+	char linha[BUFSZ];
+	uint64_t numero = 0, total = 0, capacidade = 1 << 16;
+	struct trace_registro *registros = malloc(capacidade * sizeof(*registros));
+	FILE *entrada = fopen(arquivo, "r");
+	if(!entrada || !registros) {
+		if(!entrada) perror(arquivo);
+		if(entrada) fclose(entrada);
+		free(registros);
+		return -1;
+	}
+	erro = 0;
+	while(!erro && fgets(linha, BUFSZ, entrada)) {
+		if(total == capacidade) {
+			struct trace_registro *maior = realloc(registros, 2 * capacidade * sizeof(*registros));
+			if(!maior) {
+				erro = -1;
+				break;
+			}
+			registros = maior;
+			capacidade *= 2;
+		}
+		int ok = montar_registro(linha, ++numero, &registros[total]);
+		if(ok < 0) erro = -1;
+		else total += ok;
+	}
+	fclose(entrada);
+	if(!erro) erro = reproduzir_registros(registros, total, threads);
+	free(registros);
+	return erro;
+}
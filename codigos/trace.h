@@ -0,0 +1,62 @@
+#ifndef TPSO2_trace_h
+#define TPSO2_trace_h
+
+#include <stdio.h>
+#include <inttypes.h>
+
+// Comandos de um arquivo de acessos:
+#define TRACE_NENHUM 0 // comentário ou linha desconhecida
+#define TRACE_ALLOC  1
+#define TRACE_FREE   2
+#define TRACE_READ   3
+#define TRACE_WRITE  4
+#define TRACE_SWAP   5
+#define TRACE_EXIT   6 // encerra o processo do dado
+#define TRACE_FREE_RANGE 7 // libera de endereço até o dado, exclusive
+#define TRACE_ALLOC_RANGE 8 // aloca dado páginas a partir de endereço
+#define TRACE_FORK   9 // cria o processo do dado a partir do processo do endereço
+
+/* Formato binário do arquivo de acessos: um cabeçalho seguido de registros de tamanho fixo na ordem de bytes da máquina.
+ * Cada registro tem 8 bytes: o comando nos 8 bits mais significativos da primeira palavra, o endereço virtual (24 bits) nos demais,
+ * e na segunda palavra o dado escrito (write), o id do processo (swap, exit, filho do fork), o fim do intervalo (free_range) ou o número de páginas (alloc_range). */
+#define TRACE_MAGICA "TPSO2TRC"
+#define TRACE_VERSAO 1
+#define TRACE_ORDEM  0x01020304 // confere se o arquivo foi gravado numa máquina com a mesma ordem de bytes
+
+struct trace_cabecalho {
+	char magica[8];
+	uint32_t versao;
+	uint32_t ordem;
+	uint64_t registros;
+};
+
+struct trace_registro {
+	uint32_t comando_endereco;
+	uint32_t dado;
+};
+
+#define REGISTRO_COMANDO(r) ((r)->comando_endereco >> 24)
+#define REGISTRO_ENDERECO(r) ((r)->comando_endereco & 0x00FFFFFF)
+
+// Decodifica uma linha do formato texto. Retorna o comando (TRACE_NENHUM para comentários e linhas desconhecidas):
+int traduzir_linha(const char *linha, uint32_t *endereco, uint32_t *dado);
+// Executa um comando no simulador:
+void executar_comando(int comando, uint32_t endereco, uint32_t dado);
+
+/* Os allocs de páginas seguidas são juntados num único alloc_range antes de chegar ao sistema operacional. Os comandos passam por
+ * executar_juntando, que segura a sequência de allocs em andamento; terminar_juntando executa o que ainda estiver guardado. */
+struct juncao {
+	uint32_t inicio;
+	uint32_t paginas;
+};
+void executar_juntando(struct juncao *j, int comando, uint32_t endereco, uint32_t dado);
+void terminar_juntando(struct juncao *j);
+// Reproduzem um arquivo de acessos inteiro. Retornam 0 em caso de sucesso:
+int reproduzir_texto(FILE *entrada);
+int reproduzir_binario(const char *arquivo);
+// Reproduz o arquivo (texto ou binário) com os processos divididos entre threads, cada uma simulando uma CPU. Retorna 0 em caso de sucesso:
+int reproduzir_paralelo(const char *arquivo, int binario, unsigned threads);
+// Converte um arquivo de acessos do formato texto para o binário. Retorna 0 em caso de sucesso:
+int converter_trace(FILE *entrada, const char *saida);
+
+#endif
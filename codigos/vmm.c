@@ -1,12 +1,22 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS e MAP_NORESERVE */
+#define _GNU_SOURCE /* fallocate e FALLOC_FL_PUNCH_HOLE */
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
 #include <assert.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 /*Este cabeçalho traz a definição da macro assert() que implementa uma asserção, utilizada para verificar suposições feitas pelo programa. Sempre que a expressão passada como argumento é falsa (igual a zero) então a macro escreve uma mensagem na saída padrão de erro e termina o programa chamando abort()1 .
 Através da macro é possível diagnosticar problemas através da informação impressa pela macro1 que contém o nome do arquivo fonte, a linha do arquivo contendo a chamada para a macro, o nome da função que contém a chamada e o texto da expressão que foi avaliada.*/
 
 #include "vmm.h"
+#include "log.h"
+#include "estatisticas.h"
 
 /* O arranjo __frames representa a memoria fisica do computador.
  * A variavel __pagetable eh o numero do quadro na memoria fisica que contem a tabela de paginas corrente.
@@ -17,15 +27,21 @@ Através da macro é possível diagnosticar problemas através da informação i
  * bits necessaria nos enderecos fisicos? */
 
 //#define NUMFRAMES 0x1000
-//static struct frame __frames[NUMFRAMES]; /* a memoria fisica possui 4.096 frames*/
-//static uint32_t __pagetable; /*__pagetable eh o numero do quadro na memoria fisica que contem a tabela de paginas corrente. */
+struct frame __frames[NUMFRAMES]; /* a memoria fisica possui 4.096 frames*/
+_Thread_local uint32_t __pagetable; /*__pagetable eh o numero do quadro na memoria fisica que contem a tabela de paginas corrente. */
 
 extern uint32_t os_pagefault(uint32_t address, uint32_t permissao, uint32_t pte);
 
+static void dccvmm_psc_clear(void);
+
 /* A funcao dccvmm_set_page_table informa ao controlador de memoria em qual
- * frame esta a tabela de paginas corrente. */
+ * frame esta a tabela de paginas corrente.  As entradas da TLB sao marcadas
+ * com a tabela em que foram carregadas, entao a troca nao esvazia a TLB; o
+ * cache de ptes de nivel 1 da CPU eh esvaziado. */
 void dccvmm_set_page_table(uint32_t framenum) {
-    printf("vmm using pagetable in frame %x\n", framenum);
+    LOG_ACESSO(EVENTO_TABELA, 0, framenum, 0);
+    ESTAT_INC(trocas_tabela);
+    dccvmm_psc_clear();
     __pagetable = framenum;
 }
 
@@ -41,6 +57,7 @@ static uint32_t dccvmm_get_pte(uint32_t frame, uint8_t ptenum, uint32_t perms, u
 	//printf("(RETIRAR ESTE PRINT) pte = __frames[%i].words[%X] \n", frame, ptenum );
 	
     uint32_t pte = __frames[frame].words[ptenum];
+    ESTAT_INC(leituras_pte);
    	//printf("(RETIRAR ESTE PRINT) pte: 0x%X\n", pte);
     
     /*Eu acho que aqui, ele comprara a página calculada anteriormente com o vetor de permissoes para ver se esta pagina pode ser recuperada*/
@@ -49,7 +66,10 @@ static uint32_t dccvmm_get_pte(uint32_t frame, uint8_t ptenum, uint32_t perms, u
          * VM_ABORT? Cite um exemplo onde os_pagefault retorna
          * VM_ABORT. */
         uint32_t r = os_pagefault(address, perms, pte);
-        if (r == VM_ABORT) return VM_ABORT;
+        if (r == VM_ABORT) {
+            ESTAT_INC(abortos);
+            return VM_ABORT;
+        }
     }
     pte = __frames[frame].words[ptenum];
     return pte;
@@ -57,6 +77,405 @@ static uint32_t dccvmm_get_pte(uint32_t frame, uint8_t ptenum, uint32_t perms, u
      * o valor de VM_ABORT que pode ser retornado no if acima? */
 }
 
+/*****************************************************************************
+ * TLB
+ ****************************************************************************/
+struct tlb_entry {
+    uint32_t pagetable; /* frame da tabela de nivel 1 em que a traducao foi feita */
+    uint32_t page;      /* numero da pagina virtual (PAGENUM) */
+    uint32_t pte;       /* pte de nivel 2 da pagina */
+    uint64_t stamp;     /* instante do ultimo uso (LRU) ou da insercao (FIFO) */
+    uint32_t valid;
+};
+
+/* Entrada do cache de ptes de nivel 1 (paging-structure cache). */
+struct psc_entry {
+    uint32_t pagetable; /* frame da tabela de nivel 1 */
+    uint32_t index;     /* PTE1OFF do endereco */
+    uint32_t pte;       /* pte de nivel 1, que aponta para a tabela de nivel 2 */
+    uint32_t valid;
+};
+
+/* Cada thread que acessa a memoria simula uma CPU, com a sua TLB e o seu
+ * registrador de tabela de paginas (__pagetable).  A geometria da TLB eh a
+ * mesma em todas as CPUs. */
+struct cpu {
+    pthread_mutex_t lock;   /* protege a TLB contra invalidacoes de outras CPUs */
+    struct tlb_entry *tlb;
+    struct psc_entry *psc;  /* cache de ptes de nivel 1, direto por PTE1OFF */
+    uint64_t clock;
+    uint32_t seed;
+};
+
+static uint32_t __tlb_sets;
+static uint32_t __tlb_ways;
+static int __tlb_policy;
+static uint32_t __psc_entries = DCCVMM_PSC_ENTRIES;
+
+static _Thread_local struct cpu *__cpu;
+static struct cpu *__cpus[DCCVMM_MAX_CPUS];
+static uint32_t __ncpus;
+
+/* Trava das tabelas de paginas: o percurso do controlador e as alteracoes do
+ * sistema operacional nas tabelas nao podem se sobrepor.  Ela tambem protege
+ * a lista de CPUs e os caches de ptes de nivel 1, usados so no percurso, e o
+ * sistema operacional a segura em todas as suas estruturas; assim as faltas
+ * na TLB das varias CPUs sao atendidas uma de cada vez.  So os acertos na
+ * TLB e o acesso ao quadro correm em paralelo, com a trava da CPU, que eh
+ * sempre pega depois de __pt_lock.  Com uma CPU so (__smp == 0) nenhuma
+ * trava do controlador eh usada. */
+static pthread_mutex_t __pt_lock = PTHREAD_MUTEX_INITIALIZER;
+static int __smp;
+
+#define SMP_LOCK(m) do { \
+        if (__smp && pthread_mutex_trylock(m)) { \
+            ESTAT_INC(esperas_travas); \
+            pthread_mutex_lock(m); \
+        } \
+    } while (0)
+#define SMP_UNLOCK(m) do { if (__smp) pthread_mutex_unlock(m); } while (0)
+
+void dccvmm_smp(int enable) {
+    __smp = enable;
+}
+
+void dccvmm_pt_lock(void) {
+    SMP_LOCK(&__pt_lock);
+}
+
+void dccvmm_pt_unlock(void) {
+    SMP_UNLOCK(&__pt_lock);
+}
+
+void dccvmm_cpu_start(void) {
+    struct cpu *cpu = calloc(1, sizeof (*cpu));
+    assert(cpu);
+    pthread_mutex_init(&cpu->lock, NULL);
+    cpu->seed = 0x2545f491;
+    if (__tlb_sets) {
+        cpu->tlb = calloc(__tlb_sets * __tlb_ways, sizeof (*cpu->tlb));
+        assert(cpu->tlb);
+    }
+    if (__psc_entries) {
+        cpu->psc = calloc(__psc_entries, sizeof (*cpu->psc));
+        assert(cpu->psc);
+    }
+    pthread_mutex_lock(&__pt_lock);
+    assert(__ncpus < DCCVMM_MAX_CPUS);
+    __cpus[__ncpus++] = cpu;
+    pthread_mutex_unlock(&__pt_lock);
+    __cpu = cpu;
+}
+
+void dccvmm_cpu_stop(void) {
+    uint32_t i;
+    struct cpu *cpu = __cpu;
+    if (!cpu) return;
+    pthread_mutex_lock(&__pt_lock);
+    for (i = 0; i < __ncpus && __cpus[i] != cpu; i++);
+    if (i < __ncpus) __cpus[i] = __cpus[--__ncpus];
+    pthread_mutex_unlock(&__pt_lock);
+    pthread_mutex_destroy(&cpu->lock);
+    free(cpu->tlb);
+    free(cpu->psc);
+    free(cpu);
+    __cpu = NULL;
+}
+
+/* A thread principal vira uma CPU no primeiro acesso. */
+static struct cpu *dccvmm_cpu(void) {
+    if (!__cpu) dccvmm_cpu_start();
+    return __cpu;
+}
+
+void dccvmm_tlb_config(uint32_t entries, uint32_t ways, int policy) {
+    struct cpu *cpu = dccvmm_cpu();
+    free(cpu->tlb);
+    cpu->tlb = NULL;
+    __tlb_sets = 0;
+    __tlb_ways = 0;
+    if (entries == 0) return;
+    assert(ways > 0 && entries % ways == 0);
+    __tlb_sets = entries / ways;
+    assert((__tlb_sets & (__tlb_sets - 1)) == 0);
+    __tlb_ways = ways;
+    __tlb_policy = policy;
+    cpu->tlb = calloc(entries, sizeof (*cpu->tlb));
+    assert(cpu->tlb);
+}
+
+void dccvmm_psc_config(uint32_t entries) {
+    struct cpu *cpu = dccvmm_cpu();
+    assert((entries & (entries - 1)) == 0);
+    free(cpu->psc);
+    cpu->psc = NULL;
+    __psc_entries = entries;
+    if (entries == 0) return;
+    cpu->psc = calloc(entries, sizeof (*cpu->psc));
+    assert(cpu->psc);
+}
+
+/* Procura o pte de nivel 1 de index na tabela corrente.  Como na TLB, o pte
+ * guardado so serve se tiver todas as permissoes pedidas.  Retorna 0 se ele
+ * nao esta no cache; chamada com a trava das tabelas de paginas. */
+static uint32_t dccvmm_psc_lookup(struct cpu *cpu, uint32_t index, uint32_t perms) {
+    uint32_t pte = 0;
+    if (!cpu->psc) return 0;
+    struct psc_entry *e = &cpu->psc[index & (__psc_entries - 1)];
+    if (e->valid && e->index == index && e->pagetable == __pagetable
+            && (e->pte & perms) == perms) {
+        pte = e->pte;
+    }
+    if (pte) ESTAT_INC(psc_acertos);
+    else ESTAT_INC(psc_faltas);
+    return pte;
+}
+
+/* Chamada com a trava das tabelas de paginas. */
+static void dccvmm_psc_insert(struct cpu *cpu, uint32_t index, uint32_t pte) {
+    if (!cpu->psc || __pagetable == 0) return;
+    struct psc_entry *e = &cpu->psc[index & (__psc_entries - 1)];
+    e->pagetable = __pagetable;
+    e->index = index;
+    e->pte = pte;
+    e->valid = 1;
+}
+
+static void dccvmm_psc_clear(void) {
+    struct cpu *cpu = dccvmm_cpu();
+    if (!cpu->psc) return;
+    memset(cpu->psc, 0, __psc_entries * sizeof (*cpu->psc));
+}
+
+void dccvmm_psc_invalidate(uint32_t pagetable, uint32_t index) {
+    uint32_t c;
+    if (!__psc_entries) return;
+    for (c = 0; c < __ncpus; c++) {
+        struct psc_entry *e = &__cpus[c]->psc[index & (__psc_entries - 1)];
+        if (e->valid && e->index == index && e->pagetable == pagetable) e->valid = 0;
+    }
+}
+
+/* Procura a traducao da pagina na tabela corrente.  Uma entrada so eh usada
+ * se o pte guardado tiver todas as permissoes pedidas; caso contrario o
+ * acesso percorre a tabela e o sistema operacional eh consultado. */
+static struct tlb_entry *dccvmm_tlb_lookup(struct cpu *cpu, uint32_t page, uint32_t perms) {
+    if (!cpu->tlb) return NULL;
+    struct tlb_entry *set = &cpu->tlb[(page & (__tlb_sets - 1)) * __tlb_ways];
+    uint32_t i;
+    for (i = 0; i < __tlb_ways; i++) {
+        if (set[i].valid && set[i].page == page && set[i].pagetable == __pagetable
+                && (set[i].pte & perms) == perms) {
+            if (__tlb_policy == TLB_LRU) set[i].stamp = ++cpu->clock;
+            ESTAT_INC(tlb_acertos);
+            return &set[i];
+        }
+    }
+    ESTAT_INC(tlb_faltas);
+    return NULL;
+}
+
+static void dccvmm_tlb_insert(struct cpu *cpu, uint32_t page, uint32_t pte) {
+    /* __pagetable == 0 indica que nao ha tabela de paginas carregada */
+    if (!cpu->tlb || __pagetable == 0) return;
+    struct tlb_entry *set = &cpu->tlb[(page & (__tlb_sets - 1)) * __tlb_ways];
+    struct tlb_entry *victim = NULL;
+    uint32_t i;
+    /* a pagina pode ja estar na TLB com um pte desatualizado (sem PTE_DIRTY) */
+    for (i = 0; i < __tlb_ways && !victim; i++) {
+        if (set[i].valid && set[i].page == page && set[i].pagetable == __pagetable)
+            victim = &set[i];
+    }
+    for (i = 0; i < __tlb_ways && !victim; i++) {
+        if (!set[i].valid) victim = &set[i];
+    }
+    if (!victim) {
+        if (__tlb_policy == TLB_ALEATORIA) {
+            /* xorshift32 */
+            cpu->seed ^= cpu->seed << 13;
+            cpu->seed ^= cpu->seed >> 17;
+            cpu->seed ^= cpu->seed << 5;
+            victim = &set[cpu->seed % __tlb_ways];
+        } else {
+            /* LRU e FIFO descartam a entrada de menor carimbo; so muda o
+             * momento em que o carimbo eh atualizado */
+            victim = &set[0];
+            for (i = 1; i < __tlb_ways; i++) {
+                if (set[i].stamp < victim->stamp) victim = &set[i];
+            }
+        }
+    }
+    victim->pagetable = __pagetable;
+    victim->page = page;
+    victim->pte = pte;
+    victim->stamp = ++cpu->clock;
+    victim->valid = 1;
+}
+
+/* As invalidacoes valem para as TLBs de todas as CPUs (shootdown) e sao
+ * chamadas com a trava das tabelas de paginas, que mantem a lista de CPUs
+ * fixa.  A trava de cada CPU garante que, no retorno, nenhuma delas esta no
+ * meio de um acesso feito com a traducao removida. */
+void dccvmm_tlb_invalidate(uint32_t pagetable, uint32_t address) {
+    uint32_t page = PAGENUM(address);
+    uint32_t c, i;
+    if (!__tlb_sets) return;
+    for (c = 0; c < __ncpus; c++) {
+        struct cpu *cpu = __cpus[c];
+        struct tlb_entry *set = &cpu->tlb[(page & (__tlb_sets - 1)) * __tlb_ways];
+        SMP_LOCK(&cpu->lock);
+        for (i = 0; i < __tlb_ways; i++) {
+            if (set[i].valid && set[i].page == page && set[i].pagetable == pagetable) {
+                set[i].valid = 0;
+                ESTAT_INC(tlb_invalidacoes);
+            }
+        }
+        SMP_UNLOCK(&cpu->lock);
+    }
+}
+
+void dccvmm_tlb_invalidate_page(uint32_t address) {
+    uint32_t page = PAGENUM(address);
+    uint32_t c, i;
+    if (!__tlb_sets) return;
+    for (c = 0; c < __ncpus; c++) {
+        struct cpu *cpu = __cpus[c];
+        struct tlb_entry *set = &cpu->tlb[(page & (__tlb_sets - 1)) * __tlb_ways];
+        SMP_LOCK(&cpu->lock);
+        for (i = 0; i < __tlb_ways; i++) {
+            if (set[i].valid && set[i].page == page) {
+                set[i].valid = 0;
+                ESTAT_INC(tlb_invalidacoes);
+            }
+        }
+        SMP_UNLOCK(&cpu->lock);
+    }
+}
+
+void dccvmm_tlb_flush(uint32_t pagetable) {
+    uint32_t c, i;
+    if (!__tlb_sets && !__psc_entries) return;
+    for (c = 0; c < __ncpus; c++) {
+        struct cpu *cpu = __cpus[c];
+        SMP_LOCK(&cpu->lock);
+        for (i = 0; i < __tlb_sets * __tlb_ways; i++) {
+            if (cpu->tlb[i].valid && cpu->tlb[i].pagetable == pagetable) {
+                cpu->tlb[i].valid = 0;
+                ESTAT_INC(tlb_invalidacoes);
+            }
+        }
+        for (i = 0; i < __psc_entries; i++) {
+            if (cpu->psc[i].pagetable == pagetable) cpu->psc[i].valid = 0;
+        }
+        SMP_UNLOCK(&cpu->lock);
+    }
+}
+
+void dccvmm_tlb_report(void) {
+    static const char *policies[] = { "lru", "fifo", "aleatoria" };
+    uint64_t total = estat.tlb_acertos + estat.tlb_faltas;
+    uint64_t total_psc = estat.psc_acertos + estat.psc_faltas;
+    if (!__tlb_sets) {
+        fprintf(stderr, "tlb desligada\n");
+    } else {
+        fprintf(stderr, "tlb %u entradas %u vias %s: acertos %" PRIu64 " faltas %" PRIu64
+                " invalidacoes %" PRIu64 " taxa de acerto %.2f%%\n",
+                __tlb_sets * __tlb_ways, __tlb_ways, policies[__tlb_policy],
+                estat.tlb_acertos, estat.tlb_faltas, estat.tlb_invalidacoes,
+                total ? 100.0 * estat.tlb_acertos / total : 0.0);
+    }
+    if (!__psc_entries) {
+        fprintf(stderr, "cache de ptes de nivel 1 desligado\n");
+        return;
+    }
+    fprintf(stderr, "cache de ptes de nivel 1 %u entradas: acertos %" PRIu64 " faltas %" PRIu64
+            " taxa de acerto %.2f%% leituras de pte por percurso %.3f\n",
+            __psc_entries, estat.psc_acertos, estat.psc_faltas,
+            total_psc ? 100.0 * estat.psc_acertos / total_psc : 0.0,
+            estat.percursos ? (double) estat.leituras_pte / estat.percursos : 0.0);
+}
+
+/* dccvmm_translate devolve o pte de nivel 2 do endereco virtual address na
+ * tabela de paginas atual, ou VM_ABORT se o sistema operacional cancelar o
+ * acesso.  A TLB eh consultada antes do percurso na tabela de paginas.
+ *
+ * O percurso liga PTE_ACCESSED nos ptes dos dois niveis e, se write for
+ * verdadeiro, PTE_DIRTY no pte de nivel 2.  Uma escrita so aproveita entradas
+ * da TLB que ja tenham PTE_DIRTY, para que a primeira escrita numa pagina
+ * limpa chegue ao pte.
+ *
+ * O retorno acontece com a trava da CPU e, se houve percurso (*walked), com a
+ * trava das tabelas de paginas; o acesso ao quadro eh feito com elas e
+ * liberado por dccvmm_translate_end.  O percurso pode chamar os_pagefault,
+ * que despeja paginas e invalida TLBs, entao a trava da CPU so eh pega depois
+ * dele. */
+static uint32_t dccvmm_translate(struct cpu *cpu, uint32_t address, uint32_t perms, int write, int *walked) {
+    uint32_t dirty = write ? PTE_DIRTY : 0;
+    SMP_LOCK(&cpu->lock);
+    struct tlb_entry *e = dccvmm_tlb_lookup(cpu, PAGENUM(address), perms | dirty);
+    *walked = (e == NULL);
+    if (e) return e->pte;
+    SMP_UNLOCK(&cpu->lock);
+    SMP_LOCK(&__pt_lock);
+    ESTAT_INC(percursos);
+
+    /*PTE1OFF(address) = Separa os bitos 23 a 16 de address e os coloca na posição 7 a 0
+    dccvmm_get_pte(uint32_t frame, uint8_t ptenum, uint32_t perms, uint32_t address)
+     */
+     
+    //printf("(RETIRAR ESTE PRINT) __pagetable: 0x%X\n", __pagetable);
+    //printf("(RETIRAR ESTE PRINT) PTE1OFF(address): %X\n", PTE1OFF(address));
+    //printf("(RETIRAR ESTE PRINT) perms: 0x%X\n", perms);
+    /* Um pte de nivel 1 no cache dispensa a primeira leitura na tabela; ele
+     * ja tem PTE_ACCESSED, ligado no percurso que o guardou. */
+    uint32_t pte1 = dccvmm_psc_lookup(cpu, PTE1OFF(address), perms);
+    int cached = (pte1 != 0);
+    if (!cached) pte1 = dccvmm_get_pte(__pagetable, PTE1OFF(address), perms, address);
+    uint32_t pte2 = VM_ABORT;
+    if (pte1 != VM_ABORT && (pte1 & PTE_HUGE)) {
+        /* Pagina grande: o pte de nivel 2 eh montado a partir do de nivel 1,
+         * sem uma segunda leitura na tabela de paginas. */
+        pte2 = (pte1 & ~0xfffu) | (PTEFRAME(pte1) + PTE2OFF(address));
+        SMP_LOCK(&cpu->lock);
+        if ((pte1 & perms) == perms) {
+            __frames[__pagetable].words[PTE1OFF(address)] = pte1 | PTE_ACCESSED | dirty;
+            pte2 |= PTE_ACCESSED | dirty;
+            dccvmm_tlb_insert(cpu, PAGENUM(address), pte2);
+        }
+    } else if (pte1 != VM_ABORT) {
+        uint32_t pte1frame = PTEFRAME(pte1); /*Separa os 12 bits menos significativos de pte1*/ 
+    
+        /*PTE2OFF(address) = Separa os bitos 15 a 8 de address e os coloca na posição 7 a 0
+        dccvmm_get_pte(uint32_t frame, uint8_t ptenum, uint32_t perms, uint32_t address)
+         */
+        pte2 = dccvmm_get_pte(pte1frame, PTE2OFF(address), perms, address);
+        SMP_LOCK(&cpu->lock);
+
+        /* Traducoes aceitas com permissoes incompletas nao vao para a TLB, para
+         * que o sistema operacional continue sendo consultado nelas. */
+        if (pte2 != VM_ABORT && (pte1 & perms) == perms && (pte2 & perms) == perms) {
+            pte1 |= PTE_ACCESSED;
+            if (!cached) {
+                __frames[__pagetable].words[PTE1OFF(address)] = pte1;
+                dccvmm_psc_insert(cpu, PTE1OFF(address), pte1);
+            }
+            pte2 |= PTE_ACCESSED | dirty;
+            __frames[pte1frame].words[PTE2OFF(address)] = pte2;
+            /* A permissao de escrita da traducao eh a dos dois niveis: uma
+             * tabela 2 compartilhada (os_fork) so tem PTE_RW no pte de nivel 1. */
+            dccvmm_tlb_insert(cpu, PAGENUM(address), pte2 & (pte1 | ~PTE_RW));
+        }
+    } else {
+        SMP_LOCK(&cpu->lock);
+    }
+    return pte2;
+}
+
+static void dccvmm_translate_end(struct cpu *cpu, int walked) {
+    SMP_UNLOCK(&cpu->lock);
+    if (walked) SMP_UNLOCK(&__pt_lock);
+}
+
 /* Q: Descreva o funcionamento o controlador de memoria analisando o codigo
  * das funcoes dccvmm_read, dccvmm_write, e dccvmm_get_pte.  Explique como um
  * endereco virtual eh convertido num endereco fisico.  Faca um diagrama da
@@ -75,34 +494,26 @@ uint32_t dccvmm_read(uint32_t address) {
 
 	//printf("\n\n(RETIRAR ESTE PRINT) Entrando na função \"dccvmm_read\"\n");
 	//printf("(RETIRAR ESTE PRINT) address: %X\n", address);
-    uint32_t perms = PTE_RW | PTE_INMEM | PTE_VALID; 
+    uint32_t perms = PTE_INMEM | PTE_VALID; 
     /* A operação acima eh uma combinação de:
-     * PTE_RW    0x00800000  o quadro apontado pelo pte tem permissao de leitura e escrita
      * PTE_VALID 0x00100000  o endereco virtual foi alocado pelo processo
      * PTE_INMEM 0x00400000  o quadro apontado pelo pte esta na memoria
-     * resultado 0x00D00000 ou seja, a permissao eh de leitura e escrita + é do processo + está na memória
+     * resultado 0x00500000 ou seja, é do processo + está na memória
+     * Uma leitura nao exige PTE_RW: so as escritas falham em paginas somente
+     * de leitura (as paginas compartilhadas por os_fork, por exemplo).
      */
-    
-    /*PTE1OFF(address) = Separa os bitos 23 a 16 de address e os coloca na posição 7 a 0
-    dccvmm_get_pte(uint32_t frame, uint8_t ptenum, uint32_t perms, uint32_t address)
-     */
-     
-    //printf("(RETIRAR ESTE PRINT) __pagetable: 0x%X\n", __pagetable);
-    //printf("(RETIRAR ESTE PRINT) PTE1OFF(address): %X\n", PTE1OFF(address));
-    //printf("(RETIRAR ESTE PRINT) perms: 0x%X\n", perms);
-    uint32_t pte1 = dccvmm_get_pte(__pagetable, PTE1OFF(address), perms, address);
-    if (pte1 == VM_ABORT) return 0;
-    uint32_t pte1frame = PTEFRAME(pte1); /*Separa os 12 bits menos significativos de pte1*/ 
-    
-    /*PTE2OFF(address) = Separa os bitos 15 a 8 de address e os coloca na posição 7 a 0
-    dccvmm_get_pte(uint32_t frame, uint8_t ptenum, uint32_t perms, uint32_t address)
-     */
-    uint32_t pte2 = dccvmm_get_pte(pte1frame, PTE2OFF(address), perms, address);
-    if (pte2 == VM_ABORT) return 0;
-    uint32_t pte2frame = PTEFRAME(pte2); /*Separa os 12 bits menos significativos de pte2*/ 
-    uint32_t data = __frames[pte2frame].words[PAGEOFFSET(address)]; /*Separa os bitos 7 a 0 de address*/
-    printf("vmm %x phy %x read %x\n", address,
-            (pte2frame << 8) + PAGEOFFSET(address), data); /*Separa os bitos 7 a 0 de address*/
+    struct cpu *cpu = dccvmm_cpu();
+    uint32_t data = 0;
+    int walked;
+    ESTAT_INC(leituras);
+    uint32_t pte2 = dccvmm_translate(cpu, address, perms, 0, &walked);
+    if (pte2 != VM_ABORT) {
+        uint32_t pte2frame = PTEFRAME(pte2); /*Separa os 12 bits menos significativos de pte2*/ 
+        data = __frames[pte2frame].words[PAGEOFFSET(address)]; /*Separa os bitos 7 a 0 de address*/
+        LOG_ACESSO(EVENTO_READ, address,
+                (pte2frame << 8) + PAGEOFFSET(address), data); /*Separa os bitos 7 a 0 de address*/
+    }
+    dccvmm_translate_end(cpu, walked);
     return data;
 }
 
@@ -111,7 +522,7 @@ uint32_t dccvmm_read(uint32_t address) {
 uint32_t dccvmm_phy_read(uint32_t phyaddr) {
     assert((phyaddr >> 8) < NUMFRAMES);
     uint32_t data = __frames[phyaddr >> 8].words[PAGEOFFSET(phyaddr)];
-    printf("vmm phy %x read %x\n", phyaddr, data);
+    LOG_ACESSO(EVENTO_PHY_READ, 0, phyaddr, data);
     return data;
 }
 
@@ -120,14 +531,16 @@ uint32_t dccvmm_phy_read(uint32_t phyaddr) {
 void dccvmm_write(uint32_t address, uint32_t data) {
 	//printf("\n\n(RETIRAR ESTE PRINT) Entrando na função \"dccvmm_write\"\n");
     uint32_t perms = PTE_RW | PTE_INMEM | PTE_VALID;
-    uint32_t pte1 = dccvmm_get_pte(__pagetable, PTE1OFF(address), perms, address);
-    if (pte1 == VM_ABORT) return;
-    uint32_t pte1frame = PTEFRAME(pte1);
-    uint32_t pte2 = dccvmm_get_pte(pte1frame, PTE2OFF(address), perms, address);
-    if (pte2 == VM_ABORT) return;
-    uint32_t pte2frame = PTEFRAME(pte2);
-    __frames[pte2frame].words[PAGEOFFSET(address)] = data;
-    printf("vmm %x phy %x write %x\n", address, (pte2frame << 8) + PAGEOFFSET(address), data);
+    struct cpu *cpu = dccvmm_cpu();
+    int walked;
+    ESTAT_INC(escritas);
+    uint32_t pte2 = dccvmm_translate(cpu, address, perms, 1, &walked);
+    if (pte2 != VM_ABORT) {
+        uint32_t pte2frame = PTEFRAME(pte2);
+        __frames[pte2frame].words[PAGEOFFSET(address)] = data;
+        LOG_ACESSO(EVENTO_WRITE, address, (pte2frame << 8) + PAGEOFFSET(address), data);
+    }
+    dccvmm_translate_end(cpu, walked);
 }
 
 /* dccvmm_phy_write escreve data na palavra de 32-bits apontada pelo endereco
@@ -136,7 +549,7 @@ void dccvmm_write(uint32_t address, uint32_t data) {
 void dccvmm_phy_write(uint32_t phyaddr, uint32_t data) {
     assert((phyaddr >> 8) < NUMFRAMES);
     __frames[phyaddr >> 8].words[PAGEOFFSET(phyaddr)] = data;
-    printf("vmm phy %x write %x\n", phyaddr, data);
+    LOG_ACESSO(EVENTO_PHY_WRITE, 0, phyaddr, data);
 }
 
 /* dccvmm_zero zera um quadro na memoria fisica, transpassando o sistema de
@@ -152,11 +565,52 @@ struct sector {
     uint32_t words[0x100]; /*Um setor do disco possui a mesma dimensão de um frame = 512 posições de 32 bits cada = 2KB*/
 };
 
+#define NUMSECTORS 0x00100000
+#define DISK_SIZE ((size_t) NUMSECTORS * sizeof (struct sector))
+
 static struct sector *__disk; /*apontador de uma struct tipo sector chamada __disk*/
+static const char *__disk_file; /* imagem do disco (NULL: disco anonimo, perdido no fim da execucao) */
+static int __disk_keep;         /* reaproveita o conteudo da imagem em vez de zera-la */
+static int __disk_fd = -1;
 
+/* O disco eh mapeado com mmap em vez de alocado: so os setores gravados
+ * ocupam memoria (e espaco no arquivo, que eh esparso), e dump/load viram
+ * copias no cache de paginas do sistema.  Chamadas repetidas nao fazem nada. */
 void dccvmm_init(void) {
-    __disk = malloc(0x00100000 * sizeof (*__disk));
-    assert(__disk);
+    void *disk;
+    if (__disk) return;
+    if (__disk_file) {
+        __disk_fd = open(__disk_file, O_RDWR | O_CREAT | (__disk_keep ? 0 : O_TRUNC), 0644);
+        if (__disk_fd < 0 || ftruncate(__disk_fd, DISK_SIZE)) {
+            perror(__disk_file);
+            exit(EXIT_FAILURE);
+        }
+        disk = mmap(NULL, DISK_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, __disk_fd, 0);
+    } else {
+        disk = mmap(NULL, DISK_SIZE, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    }
+    if (disk == MAP_FAILED) {
+        perror("mmap do disco");
+        exit(EXIT_FAILURE);
+    }
+    __disk = disk;
+}
+
+void dccvmm_disk_file(const char *path, int keep) {
+    __disk_file = path;
+    __disk_keep = keep;
+}
+
+void dccvmm_shutdown(void) {
+    if (!__disk) return;
+    if (__disk_fd >= 0) {
+        msync(__disk, DISK_SIZE, MS_SYNC);
+        close(__disk_fd);
+        __disk_fd = -1;
+    }
+    munmap(__disk, DISK_SIZE);
+    __disk = NULL;
 }
 
 /* O arranjo __disk acima representa o disco do computador, que sera utilizado
@@ -175,8 +629,43 @@ void dccvmm_init(void) {
  * memoria fisica no disco rigido.  Para simplificar definimos que cada setor
  * do disco tem o mesmo tamanho de um quadro de memoria fisica. */
 void dccvmm_dump_frame(uint32_t framenum, uint32_t sector) {
+    dccvmm_dump_data(&(__frames[framenum]), sector);
+}
+
+void dccvmm_dump_data(const struct frame *data, uint32_t sector) {
     /*memcpy(destino, origem, tamanho a ser copiado)*/
-    memcpy(&(__disk[sector]), &(__frames[framenum]), sizeof (__disk[0]));
+    memcpy(&(__disk[sector]), data, sizeof (__disk[0]));
+    ESTAT_INC(setores_gravados);
+}
+
+uint32_t dccvmm_discard_unit(void) {
+    long pagina = sysconf(_SC_PAGESIZE);
+    if (pagina <= (long) sizeof (struct sector)) return 1;
+    return (uint32_t) (pagina / sizeof (struct sector));
+}
+
+int dccvmm_discard_sectors(uint32_t sector, uint32_t count) {
+    size_t pagina = (size_t) dccvmm_discard_unit() * sizeof (struct sector);
+    size_t inicio = (size_t) sector * sizeof (struct sector);
+    size_t fim = inicio + (size_t) count * sizeof (struct sector);
+    int r = 0;
+    /* so paginas inteiras do hospedeiro podem ser devolvidas */
+    inicio = (inicio + pagina - 1) & ~(pagina - 1);
+    fim &= ~(pagina - 1);
+    if (!__disk || inicio >= fim) return 0;
+    if (__disk_fd < 0) {
+        r = madvise((char *) __disk + inicio, fim - inicio, MADV_DONTNEED);
+    } else {
+#ifdef FALLOC_FL_PUNCH_HOLE
+        r = fallocate(__disk_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, inicio, fim - inicio);
+#endif
+    }
+    if (r) {
+        ESTAT_INC(descartes_falhos);
+        return -1;
+    }
+    ESTAT_ADD(setores_descartados, (fim - inicio) / sizeof (struct sector));
+    return 0;
 }
 
 void dccvmm_load_frame(uint32_t sector, uint32_t framenum) {
@@ -185,4 +674,5 @@ void dccvmm_load_frame(uint32_t sector, uint32_t framenum) {
      uma informação do disco para memória, e não ao contrário como estava antes*/
     /*memcpy(&(__disk[sector]), &(__frames[framenum]), sizeof (__disk[0]));*/
     memcpy(&(__frames[framenum]), &(__disk[sector]), sizeof (__disk[0]));
+    ESTAT_INC(setores_lidos);
 }
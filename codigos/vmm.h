@@ -40,6 +40,7 @@ The typedef name uint N _t designates an unsigned integer type with width N. Thu
 #define PTE1OFF(addr) ((addr & 0x00ff0000) >> 16) /*Separa os bitos 23 a 16 de addr e os coloca na posição 7 a 0*/
 #define PTE2OFF(addr) ((addr & 0x0000ff00) >> 8)  /*Separa os bitos 15 a 8 de addr e os coloca na posição 7 a 0*/
 #define PAGEOFFSET(addr) (addr & 0x000000ff)      /*Separa os bitos 7 a 0 de addr*/
+#define PAGENUM(addr) ((addr & 0x00ffff00) >> 8)  /*Separa os bitos 23 a 8 de addr (numero da pagina virtual)*/
 
 /* O struct frame abaixo define um quadro de memoria fisica. Quadros de
  * memoria fisica sao a menor unidade controlada pelo controlador de memoria.
@@ -58,8 +59,8 @@ struct frame {
 };
 
 #define NUMFRAMES 0x1000
-struct frame __frames[NUMFRAMES]; /* a memoria fisica possui 4.096 frames*/
-uint32_t __pagetable; /*__pagetable eh o numero do quadro na memoria fisica que contem a tabela de paginas corrente. */
+extern struct frame __frames[NUMFRAMES]; /* a memoria fisica possui 4.096 frames*/
+extern _Thread_local uint32_t __pagetable; /*__pagetable eh o numero do quadro na memoria fisica que contem a tabela de paginas corrente (um por CPU). */
 
 /* Estado de uma entrada na tabela de paginas (page table entry, pte):
  *   PTE_VALID: o endereco virtual foi alocado pelo processo
@@ -72,8 +73,26 @@ uint32_t __pagetable; /*__pagetable eh o numero do quadro na memoria fisica que
 #define PTE_RW    0x00800000
 
 #define PTEFRAME(pte) (pte & 0x00000fff) /*Separa os 12 bits menos significativos de pte*/ 
-#define PTEUSER(pte) (pte & 0x7f000000) /*Separa os bits 30 a 24 de pte*/
-/* Os bits em PTEUSER sao de uso livre pelo sistema operacional. */
+#define PTEUSER(pte) (pte & 0x7e000000) /*Separa os bits 30 a 25 de pte*/
+/* Os bits em PTEUSER sao de uso livre pelo sistema operacional.
+ *
+ * O bit 24 eh o bit de referencia: o controlador de memoria liga PTE_ACCESSED
+ * nos ptes de nivel 1 e 2 sempre que percorre a tabela de paginas para
+ * traduzir um endereco, e liga PTE_DIRTY no pte de nivel 2 quando a traducao
+ * eh para uma escrita.  Os bits nunca sao desligados pelo controlador; o
+ * sistema operacional que desligar PTE_ACCESSED ou PTE_DIRTY deve invalidar a
+ * traducao na TLB para que o proximo acesso volte a percorrer a tabela e
+ * liga-los de novo. */
+#define PTE_ACCESSED 0x01000000
+
+/* O bit 25, o primeiro de PTEUSER, marca uma pagina grande num pte de nivel 1:
+ * o pte aponta direto para 256 quadros seguidos, com o primeiro alinhado em
+ * 256, e o percurso termina no nivel 1.  O quadro do endereco eh
+ * PTEFRAME(pte) + PTE2OFF(addr), e os bits de referencia e de modificacao
+ * ficam no pte de nivel 1.  A TLB guarda as traducoes de uma pagina grande
+ * pagina a pagina, como as demais. */
+#define PTE_HUGE 0x02000000
+#define HUGE_FRAMES 256
 
 /* O valor VM_ABORT deve ser usado retornado pela funcao os_pagefault quando o
  * sistema operacional precisar cancelar o acesso a memoria que causou a falha
@@ -82,6 +101,13 @@ uint32_t __pagetable; /*__pagetable eh o numero do quadro na memoria fisica que
 
 void dccvmm_init(void);
 
+/* dccvmm_disk_file faz o disco ser a imagem path, criada esparsa se nao
+ * existir; deve ser chamada antes de dccvmm_init.  Com keep, o conteudo que a
+ * imagem ja tinha eh mantido (retomada de uma execucao anterior); sem keep,
+ * o disco comeca zerado.  dccvmm_shutdown grava a imagem e desmapeia o disco. */
+void dccvmm_disk_file(const char *path, int keep);
+void dccvmm_shutdown(void);
+
 /* A funcao dccvmm_set_page_table informa ao controlador de memoria em qual
  * frame esta a tabela de paginas corrente. */
 void dccvmm_set_page_table(uint32_t framenum);
@@ -112,4 +138,100 @@ void dccvmm_zero(uint32_t framenum);
 void dccvmm_dump_frame(uint32_t framenum, uint32_t sector);
 void dccvmm_load_frame(uint32_t sector, uint32_t framenum);
 
+/* dccvmm_dump_data grava no setor um quadro que esta fora da memoria fisica,
+ * como uma transferencia por DMA de um buffer do sistema operacional. */
+void dccvmm_dump_data(const struct frame *data, uint32_t sector);
+
+/* dccvmm_discard_sectors avisa que os count setores a partir de sector estao
+ * livres: a memoria do disco anonimo que os guarda eh devolvida e a imagem
+ * ganha um buraco no lugar deles, e depois eles sao lidos como zeros.  So
+ * paginas inteiras do hospedeiro dentro do trecho sao descartadas.  Retorna
+ * 0, ou -1 se o hospedeiro recusar (madvise ou fallocate), caso em que os
+ * setores continuam ocupando memoria e a falha eh contada em estat. */
+int dccvmm_discard_sectors(uint32_t sector, uint32_t count);
+
+/* dccvmm_discard_unit retorna quantos setores seguidos ocupam uma pagina do
+ * hospedeiro (sysconf(_SC_PAGESIZE)): a menor quantidade, alinhada, que
+ * dccvmm_discard_sectors consegue devolver. */
+uint32_t dccvmm_discard_unit(void);
+
+/* O controlador de memoria possui uma TLB (translation lookaside buffer) que
+ * guarda os ptes de nivel 2 das ultimas traducoes, evitando o percurso nos
+ * dois niveis da tabela de paginas.  Cada entrada eh indexada pelo numero da
+ * pagina virtual e marcada com o frame da tabela de paginas (__pagetable) em
+ * que foi carregada, de modo que trocar de tabela nao exige esvaziar a TLB.
+ *
+ * Como no hardware real, a TLB nao eh coerente com a tabela de paginas: o
+ * sistema operacional deve chamar dccvmm_tlb_invalidate sempre que alterar
+ * ou remover um pte de nivel 2 ou retirar uma permissao de um pte de nivel
+ * 1, e dccvmm_tlb_flush antes de reaproveitar o frame de uma tabela de
+ * nivel 1 liberada. */
+#define TLB_LRU       0
+#define TLB_FIFO      1
+#define TLB_ALEATORIA 2
+
+/* dccvmm_tlb_config define o numero de entradas, a associatividade (vias) e
+ * a politica de substituicao da TLB.  O numero de conjuntos (entradas/vias)
+ * deve ser potencia de 2; entradas == 0 desliga a TLB. */
+void dccvmm_tlb_config(uint32_t entries, uint32_t ways, int policy);
+
+/* dccvmm_tlb_invalidate remove da TLB a traducao do endereco virtual
+ * address na tabela de paginas que esta no frame pagetable. */
+void dccvmm_tlb_invalidate(uint32_t pagetable, uint32_t address);
+
+/* dccvmm_tlb_invalidate_page remove da TLB a traducao do endereco virtual
+ * address em todas as tabelas de paginas, para ptes de nivel 2 que estao
+ * numa tabela compartilhada por mais de uma tabela de nivel 1. */
+void dccvmm_tlb_invalidate_page(uint32_t address);
+
+/* dccvmm_tlb_flush remove da TLB todas as traducoes da tabela de paginas que
+ * esta no frame pagetable. */
+void dccvmm_tlb_flush(uint32_t pagetable);
+
+/* dccvmm_tlb_report imprime em stderr os contadores de acerto e falta da TLB
+ * e do cache de ptes de nivel 1. */
+void dccvmm_tlb_report(void);
+
+/* Alem da TLB, cada CPU guarda num cache pequeno os ptes de nivel 1 usados
+ * nos ultimos percursos, indexado por PTE1OFF e marcado com a tabela de
+ * paginas (paging-structure cache).  Um percurso que acha o pte de nivel 1 no
+ * cache le so o pte de nivel 2: uma leitura na tabela em vez de duas.  Paginas
+ * grandes nao entram no cache; a TLB ja guarda as traducoes delas.
+ *
+ * O cache tambem nao eh coerente com a tabela de paginas.  Ele eh esvaziado
+ * por dccvmm_set_page_table (so na CPU que troca de tabela) e, para a tabela
+ * pagetable, por dccvmm_tlb_flush.  O sistema operacional deve chamar
+ * dccvmm_psc_invalidate sempre que alterar ou remover um pte de nivel 1 que
+ * aponta para uma tabela de nivel 2. */
+#define DCCVMM_PSC_ENTRIES 16
+
+/* dccvmm_psc_config define o numero de entradas do cache, potencia de 2
+ * (padrao DCCVMM_PSC_ENTRIES); entries == 0 desliga o cache. */
+void dccvmm_psc_config(uint32_t entries);
+
+/* dccvmm_psc_invalidate remove de todas as CPUs o pte de nivel 1 de indice
+ * index da tabela de paginas que esta no frame pagetable. */
+void dccvmm_psc_invalidate(uint32_t pagetable, uint32_t index);
+
+/* Varias CPUs: cada thread que acessa a memoria eh uma CPU, com a sua TLB e o
+ * seu valor de __pagetable.  A thread principal vira uma CPU sozinha; as
+ * demais chamam dccvmm_cpu_start antes do primeiro acesso e dccvmm_cpu_stop
+ * no fim.  As invalidacoes da TLB valem para todas as CPUs.
+ *
+ * dccvmm_smp(1) liga as travas do controlador e deve ser chamada antes de
+ * criar as threads; sem ela o controlador supoe uma CPU so e nao trava nada.
+ * Com as travas ligadas, o percurso na tabela de paginas (e portanto
+ * os_pagefault) roda com a trava das tabelas de paginas, que o sistema
+ * operacional tambem deve pegar com dccvmm_pt_lock antes de alterar ptes
+ * fora de os_pagefault, trocar de tabela ou invalidar a TLB.  So os acertos
+ * na TLB correm em paralelo; as faltas na TLB sao atendidas uma de cada vez.
+ * dccvmm_tlb_config e dccvmm_psc_config so podem ser chamadas com uma CPU. */
+#define DCCVMM_MAX_CPUS 128
+
+void dccvmm_smp(int enable);
+void dccvmm_cpu_start(void);
+void dccvmm_cpu_stop(void);
+void dccvmm_pt_lock(void);
+void dccvmm_pt_unlock(void);
+
 #endif